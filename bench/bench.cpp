@@ -0,0 +1,581 @@
+#include "Occulus.h"
+#include "CameraPath.h"
+#include "FrameReport.h"
+#include "VertexCache.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <new>
+
+// Open Worldgen micro-benchmarks
+// - Headless: links against Occulus, OpenSimplex, ClimateLayer and settings
+//   only, no window or GL context is needed.
+// - Usage: bench [-dim N]... [-threads N] [-time MS] [-filter TEXT] [-o FILE]
+//                [-path NAME|FILE [-frames N] [-fps N] [-budget MS] [-steady N]]
+//   -dim may be given more than once, every grid benchmark runs at each size.
+//   -path replays a camera path (a canned one, see CameraPath::canned, or a
+//   recorded file) at each size instead of running the micro-benchmarks.
+//   -steady N makes a replay fail (exit status 2) if any frame from the Nth
+//   on allocates from the heap; every frame's allocations are reported.
+//   -threads runs the noise, mapNoise, initMap and refresh benchmarks on N
+//   independent instances at once; the rest run one instance at a time.
+//   Every instance spreads its generation over its own job system.
+// - Inputs are synthetic but deterministic: a fixed noise seed, fixed
+//   coordinates from a fixed LCG and fixed camera motion.
+// - Results are written as JSON, to stdout unless -o is given.
+
+using std::string;
+typedef std::chrono::steady_clock Clock;
+
+// Options
+// @description
+// - Command line settings for a run.
+struct Options {
+	vector<int> dims;
+	int threads = 1;
+	double minTime = 200.0; // milliseconds spent on each benchmark
+	string filter;
+	string out;
+	string path;
+	int frames = 600; // length of canned paths
+	double fps = 0.0; // frame rate to pace path replays at, 0 to run them flat out
+	double budget = 0.0; // generation budget per frame for path replays, in milliseconds
+	int steady = -1;     // first frame of a replay that must not allocate, -1 not to check
+};
+
+// Result
+// @description
+// - Timings for one benchmark at one size and thread count. Samples are the
+//   nanoseconds each iteration took, across all threads.
+struct Result {
+	string name;
+	int dim;
+	int threads;
+	double items; // work items per iteration (samples, sectors, vertices...)
+	double wall;  // wall clock nanoseconds for the whole run
+	vector<double> samples;
+	vector<std::pair<string, double> > metrics; // extra figures written alongside the timings
+};
+
+static volatile double sink; // keeps results of pure functions alive
+
+// Allocation hook
+// - Every heap allocation in the process, on any thread, goes through this
+//   operator new, so path replays can count the allocations each frame makes.
+static std::atomic<long long> allocations(0);
+
+void *operator new(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void *p = malloc(size ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept {
+	free(p);
+}
+void operator delete(void *p, size_t) noexcept {
+	free(p);
+}
+
+// Measure Function
+// @param
+// - opt: the run options
+// - name: the benchmark name
+// - dim: the grid size, 0 for benchmarks without one
+// - threads: the number of threads to run the body on
+// - items: work items done by one call of body
+// - body: the work for one iteration, given the thread number
+// @description
+// - Runs body on every thread until the minimum time has passed (at least
+//   once each) and collects the per-iteration timings.
+static Result measure(const Options &opt, const string &name, int dim, int threads, double items,
+	const std::function<void(int)> &body) {
+	Result res = { name, dim, threads, items, 0.0, vector<double>(), {} };
+	vector<vector<double> > perThread(threads);
+	auto deadline = Clock::now() + std::chrono::microseconds((long long)(opt.minTime * 1000.0));
+	auto run = [&](int t) {
+		do {
+			auto t0 = Clock::now();
+			body(t);
+			auto t1 = Clock::now();
+			perThread[t].push_back(std::chrono::duration<double, std::nano>(t1 - t0).count());
+		} while (Clock::now() < deadline);
+	};
+
+	auto start = Clock::now();
+	vector<std::thread> pool;
+	for (int t = 1; t < threads; t++) {
+		pool.push_back(std::thread(run, t));
+	}
+	run(0);
+	for (size_t t = 0; t < pool.size(); t++) {
+		pool[t].join();
+	}
+	res.wall = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+	for (int t = 0; t < threads; t++) {
+		res.samples.insert(res.samples.end(), perThread[t].begin(), perThread[t].end());
+	}
+	return res;
+}
+
+// Bench
+// @description
+// - Friend of Occulus, gives the benchmarks access to the individual stages
+//   of map generation.
+class Bench {
+public:
+	// every sector re-evaluates every octave, then combines
+	static void mapNoise(Occulus &o) {
+		for (int idx = 0; idx < (int)o.map.size(); idx++) {
+			o.map[idx].evaluated = 0;
+			o.mapNoise(o.map[idx], o.tiles, idx, LOD_FULL);
+			o.combine(o.map[idx], o.tiles, idx);
+		}
+	}
+	static void initMap(Occulus &o) {
+		o.map.clear();
+		o.initMap();
+	}
+	// the first build under a budget, up to the point the first frame can render
+	static void initMapStreaming(Occulus &o, double budget) {
+		o.map.clear();
+		o.budget = budget;
+		o.initMap();
+		o.budget = 0.0;
+	}
+	// pretend an octave frequency changed so refresh has to re-evaluate noise
+	static void staleBake(Occulus &o) {
+		o.bakedFx[0] = -1.0f;
+	}
+	// one step of motion; zDir and xDir use the same flags as calcFlags
+	static void updateMap(Occulus &o, int zDir, int xDir) {
+		const float mov[] = { 0.0f, -1.0f, 1.0f };
+		o.position.z += mov[zDir] * o.spacing;
+		o.position.x += mov[xDir] * o.spacing;
+		o.updateMap();
+	}
+};
+
+// Noise Coordinates Function
+// @param
+// - count: the number of coordinates to make
+// @description
+// - Deterministic pseudo-random coordinates in [-64, 64), from an LCG with a
+//   fixed seed.
+static vector<double> noiseCoordinates(int count) {
+	vector<double> c(count);
+	uint32_t state = 12345u;
+	for (int i = 0; i < count; i++) {
+		state = state * 1664525u + 1013904223u;
+		c[i] = (state >> 8) / double(1 << 24) * 128.0 - 64.0;
+	}
+	return c;
+}
+
+// Grid Faces Function
+// @param
+// - dim: the grid size in vertices
+// @description
+// - A grid's faces in plain row-major order, the order the public draw
+//   builds a terrain chunk's faces in before optimizing them.
+static vector<uvec3> gridFaces(int dim) {
+	vector<uvec3> faces;
+	for (int i = 0; i < dim - 1; i++) {
+		for (int j = 0; j < dim - 1; j++) {
+			int v[] = { i*dim + j, i*dim + (j + 1), (i + 1)*dim + j, (i + 1)*dim + (j + 1) };
+			faces.push_back(uvec3(v[0], v[1], v[2]));
+			faces.push_back(uvec3(v[3], v[2], v[1]));
+		}
+	}
+	return faces;
+}
+
+// Add Cache Metrics Function
+// @description
+// - Appends the vertex cache figures of a face order to a result, prefixed
+//   with the name of the order.
+static void addCacheMetrics(Result &res, const string &prefix, const vector<uvec3> &faces, int vertexCount) {
+	VertexCacheStats stats = vertexCacheStats(faces, vertexCount);
+	res.metrics.push_back(std::make_pair(prefix + "acmr", (double)stats.acmr));
+	res.metrics.push_back(std::make_pair(prefix + "atvr", (double)stats.atvr));
+}
+
+// Run Noise Benchmarks Function
+// @description
+// - Raw open simplex throughput in 2, 3 and 4 dimensions.
+static void runNoise(const Options &opt, vector<Result> &results) {
+	const int count = 1 << 14;
+	const vector<double> c = noiseCoordinates(count + 3);
+	vector<struct osn_context *> ctx(opt.threads);
+	for (int t = 0; t < opt.threads; t++) {
+		open_simplex_noise(77374, &ctx[t]);
+	}
+
+	if (opt.filter.empty() || string("noise2").find(opt.filter) != string::npos) {
+		results.push_back(measure(opt, "noise2", 0, opt.threads, count, [&](int t) {
+			double s = 0.0;
+			for (int i = 0; i < count; i++) {
+				s += open_simplex_noise2(ctx[t], c[i], c[i + 1]);
+			}
+			sink = s;
+		}));
+	}
+	if (opt.filter.empty() || string("noise3").find(opt.filter) != string::npos) {
+		results.push_back(measure(opt, "noise3", 0, opt.threads, count, [&](int t) {
+			double s = 0.0;
+			for (int i = 0; i < count; i++) {
+				s += open_simplex_noise3(ctx[t], c[i], c[i + 1], c[i + 2]);
+			}
+			sink = s;
+		}));
+	}
+	if (opt.filter.empty() || string("noise4").find(opt.filter) != string::npos) {
+		results.push_back(measure(opt, "noise4", 0, opt.threads, count, [&](int t) {
+			double s = 0.0;
+			for (int i = 0; i < count; i++) {
+				s += open_simplex_noise4(ctx[t], c[i], c[i + 1], c[i + 2], c[i + 3]);
+			}
+			sink = s;
+		}));
+	}
+
+	for (int t = 0; t < opt.threads; t++) {
+		open_simplex_noise_free(ctx[t]);
+	}
+}
+
+// Run Grid Benchmarks Function
+// @param
+// - dim: the view size to run at
+// @description
+// - Map generation, movement and meshing for one view size.
+static void runGrid(const Options &opt, int dim, vector<Result> &results) {
+	auto wanted = [&](const string &name) {
+		return opt.filter.empty() || name.find(opt.filter) != string::npos;
+	};
+	auto create = [&](int count) {
+		vector<std::unique_ptr<Occulus> > o;
+		for (int t = 0; t < count; t++) {
+			o.push_back(std::unique_ptr<Occulus>(Occulus::create(vec3(0.0f, 0.0f, 0.0f), dim)));
+		}
+		return o;
+	};
+	const int threads = opt.threads;
+
+	if (wanted("mapNoise")) {
+		auto o = create(threads);
+		results.push_back(measure(opt, "mapNoise", o[0]->dim, threads, o[0]->map.size(), [&](int t) {
+			Bench::mapNoise(*o[t]);
+		}));
+	}
+	if (wanted("initMap")) {
+		auto o = create(threads);
+		results.push_back(measure(opt, "initMap", o[0]->dim, threads, o[0]->map.size(), [&](int t) {
+			Bench::initMap(*o[t]);
+		}));
+		results.push_back(measure(opt, "initMap_streaming", o[0]->dim, threads, o[0]->map.size(), [&](int t) {
+			Bench::initMapStreaming(*o[t], 4.0);
+		}));
+	}
+	if (wanted("refresh")) {
+		auto o = create(threads);
+		results.push_back(measure(opt, "refresh", o[0]->dim, threads, o[0]->map.size(), [&](int t) {
+			o[t]->refresh();
+		}));
+		results.push_back(measure(opt, "refresh_rebake", o[0]->dim, threads, o[0]->map.size(), [&](int t) {
+			Bench::staleBake(*o[t]);
+			o[t]->refresh();
+		}));
+	}
+
+	// the rest spread their work over each instance's job system, so they run one instance at a time
+	const char *dirNames[] = { "", "_forward", "_backward" };
+	const char *sideNames[] = { "", "_left", "_right" };
+	for (int zDir = 0; zDir < 3; zDir++) {
+		for (int xDir = 0; xDir < 3; xDir++) {
+			string name = string("updateMap") + dirNames[zDir] + sideNames[xDir];
+			if ((zDir || xDir) && wanted(name)) {
+				auto o = create(1);
+				int n = o[0]->dim;
+				int fresh = (zDir ? n : 0) + (xDir ? n : 0) - (zDir && xDir ? 1 : 0); // sectors generated per step
+				results.push_back(measure(opt, name, n, 1, fresh, [&](int) {
+					Bench::updateMap(*o[0], zDir, xDir);
+				}));
+			}
+		}
+	}
+
+	auto o = create(1);
+	vector<vec4> vertices, normals;
+	vector<vec2> uvs;
+	vector<float> temps, heights;
+	vector<uvec3> faces;
+	if (wanted("draw")) {
+		results.push_back(measure(opt, "draw", o[0]->dim, 1, o[0]->map.size(), [&](int) {
+			vertices.clear(); normals.clear(); uvs.clear();
+			temps.clear(); heights.clear(); faces.clear();
+			o[0]->draw(vertices, normals, uvs, temps, heights, faces);
+		}));
+		addCacheMetrics(results.back(), "", faces, vertices.size());
+	}
+	if (wanted("drawUpdate")) {
+		if (!normals.size()) {
+			o[0]->draw(vertices, normals, uvs, temps, heights, faces);
+		}
+		results.push_back(measure(opt, "drawUpdate", o[0]->dim, 1, normals.size(), [&](int) {
+			o[0]->draw(normals, temps, heights);
+		}));
+	}
+	if (wanted("drawWater")) {
+		vector<vec4> wVertices;
+		vector<vec2> wUvs;
+		vector<uvec3> wFaces;
+		results.push_back(measure(opt, "drawWater", o[0]->dim, 1, o[0]->map.size(), [&](int) {
+			wVertices.clear(); wUvs.clear(); wFaces.clear();
+			o[0]->drawWater(wVertices, wUvs, wFaces);
+		}));
+	}
+	if (wanted("optimizeFaces")) {
+		vector<uvec3> grid = gridFaces(C_DIM + 1);
+		vector<uvec3> work;
+		results.push_back(measure(opt, "optimizeFaces", o[0]->dim, 1, grid.size(), [&](int) {
+			work = grid;
+			optimizeFaces(work, o[0]->chunkSize());
+		}));
+		addCacheMetrics(results.back(), "row_major_", grid, o[0]->chunkSize());
+		addCacheMetrics(results.back(), "", work, o[0]->chunkSize());
+	}
+	if (wanted("waterChunks")) {
+		vector<int> chunks;
+		results.push_back(measure(opt, "waterChunks", o[0]->dim, 1, o[0]->map.size(), [&](int) {
+			o[0]->waterChunks(seaLevel, chunks);
+		}));
+	}
+	if (wanted("raycast")) {
+		// a fan of rays from above the center, sweeping out to the edges at a shallow angle
+		const int rays = 256;
+		const float reach = o[0]->size * 0.5f;
+		int hits = 0;
+		results.push_back(measure(opt, "raycast", o[0]->dim, 1, rays, [&](int) {
+			hits = 0;
+			for (int r = 0; r < rays; r++) {
+				float a = r * 6.2831853f / rays;
+				vec3 origin = o[0]->position + vec3(0.0f, 2.0f, 0.0f);
+				vec3 dir(cosf(a) * reach, -1.0f - (r % 8) * 0.25f, sinf(a) * reach);
+				vec3 hit;
+				hits += o[0]->raycast(origin, dir, 2.0f * glm::length(dir), hit);
+			}
+		}));
+		results.back().metrics.push_back(std::make_pair(string("hit_ratio"), hits / (double)rays));
+	}
+	if (wanted("sample")) {
+		// scattered points inside the view area, then the same pattern well outside it
+		const int points = 4096;
+		vector<vec2> inside(points), outside(points);
+		vector<float> h(points), t(points);
+		for (int k = 0; k < points; k++) {
+			vec2 p(o[0]->size * ((k * 37 % 1009) / 1009.0f - 0.5f), o[0]->size * ((k * 53 % 1013) / 1013.0f - 0.5f));
+			inside[k] = vec2(o[0]->position.x, o[0]->position.z) + p * 0.9f;
+			outside[k] = inside[k] + vec2(o[0]->size * 2.0f, 0.0f);
+		}
+		results.push_back(measure(opt, "sample", o[0]->dim, 1, points, [&](int) {
+			o[0]->sample(inside.data(), points, h.data(), t.data());
+		}));
+		results.push_back(measure(opt, "sample_outside", o[0]->dim, 1, points, [&](int) {
+			o[0]->sample(outside.data(), points, h.data(), t.data());
+		}));
+	}
+	if (wanted("regionBounds")) {
+		const int regions = 256;
+		const float extent = o[0]->size * 0.5f;
+		const float cell = o[0]->size / o[0]->dim;
+		results.push_back(measure(opt, "regionBounds", o[0]->dim, 1, regions, [&](int) {
+			float lo = 0.0f;
+			for (int r = 0; r < regions; r++) {
+				vec2 c(o[0]->position.x + extent * ((r * 37 % 101) / 50.5f - 1.0f),
+					o[0]->position.z + extent * ((r * 53 % 103) / 51.5f - 1.0f));
+				vec2 half(cell * (1 + r % 32));
+				lo += o[0]->regionBounds(c - half, c + half).lo;
+			}
+			sink = lo;
+		}));
+	}
+}
+
+// Write JSON Function
+// @description
+// - One object per result; times in nanoseconds per iteration, throughput in
+//   work items per second across all threads.
+static void writeJson(FILE *f, const Options &opt, const vector<Result> &results) {
+	fprintf(f, "{\n  \"threads\": %d,\n  \"min_time_ms\": %g,\n  \"benchmarks\": [", opt.threads, opt.minTime);
+	for (size_t r = 0; r < results.size(); r++) {
+		const Result &res = results[r];
+		vector<double> s = res.samples;
+		std::sort(s.begin(), s.end());
+		double total = 0.0;
+		for (size_t i = 0; i < s.size(); i++) {
+			total += s[i];
+		}
+		fprintf(f, "%s\n    {\"name\": \"%s\", \"dim\": %d, \"threads\": %d, \"iterations\": %zu, "
+			"\"items_per_iteration\": %.0f, \"ns_mean\": %.1f, \"ns_min\": %.1f, \"ns_p50\": %.1f, "
+			"\"ns_p90\": %.1f, \"ns_p99\": %.1f, \"items_per_second\": %.1f",
+			r ? "," : "", res.name.c_str(), res.dim, res.threads, s.size(), res.items,
+			total / s.size(), s.front(), percentile(s, 50.0), percentile(s, 90.0), percentile(s, 99.0),
+			res.items * s.size() / (res.wall * 1e-9));
+		for (size_t m = 0; m < res.metrics.size(); m++) {
+			fprintf(f, ", \"%s\": %.4f", res.metrics[m].first.c_str(), res.metrics[m].second);
+		}
+		fprintf(f, "}");
+	}
+	fprintf(f, "\n  ]\n}\n");
+}
+
+// Run Path Function
+// @param
+// - path: the camera path to replay
+// - dim: the view size to run at
+// - f: where to write the report
+// @description
+// - Replays a camera path the way the render loop drives the view area and
+//   reports per-frame generation, meshing and upload times. There is no GL
+//   context, so upload is the copy into a staging buffer that glBufferData
+//   would make. With -fps each frame then sleeps out the rest of its frame
+//   time, the way vsync would, which gives background work its idle time.
+//   -budget gives the view area a generation budget, as the program does.
+//   Heap allocations are counted over the whole frame, including the job
+//   workers'. Returns false if a frame from -steady on allocated.
+static bool runPath(const Options &opt, const CameraPath &path, int dim, FILE *f) {
+	std::unique_ptr<Occulus> o(Occulus::create(path.frames[0].eye, dim, opt.budget));
+	vector<vec4> vertices, normals;
+	vector<vec2> uvs;
+	vector<float> temps, heights;
+	vector<uvec3> faces;
+	o->draw(vertices, normals, uvs, temps, heights, faces);
+
+	vector<char> staging(normals.size() * sizeof(vec4) + (temps.size() + heights.size()) * sizeof(float));
+	FrameReport report;
+	for (int i = 0; i < (int)path.frames.size(); i++) {
+		FrameTimes t;
+		long long allocated = allocations.load();
+		auto t0 = Clock::now();
+		if (path.apply(i)) {
+			o->refresh();
+		}
+		else {
+			o->move(path.frames[i].eye);
+		}
+		auto t1 = Clock::now();
+		o->draw(normals, temps, heights);
+		auto t2 = Clock::now();
+		char *dst = staging.data();
+		memcpy(dst, normals.data(), normals.size() * sizeof(vec4));
+		dst += normals.size() * sizeof(vec4);
+		memcpy(dst, temps.data(), temps.size() * sizeof(float));
+		dst += temps.size() * sizeof(float);
+		memcpy(dst, heights.data(), heights.size() * sizeof(float));
+		auto t3 = Clock::now();
+		t.allocations = allocations.load() - allocated;
+		t.generate = std::chrono::duration<double, std::milli>(t1 - t0).count();
+		t.mesh = std::chrono::duration<double, std::milli>(t2 - t1).count();
+		t.upload = std::chrono::duration<double, std::milli>(t3 - t2).count();
+		report.add(t);
+		if (opt.fps > 0.0) {
+			std::this_thread::sleep_until(t0 + std::chrono::duration<double>(1.0 / opt.fps));
+		}
+	}
+	sink = staging[staging.size() / 2];
+	report.write(f, opt.path, o->dim);
+	if (opt.steady >= 0 && report.lastAllocating() >= opt.steady) {
+		fprintf(stderr, "%s at %d: frame %d allocated, past -steady %d\n",
+			opt.path.c_str(), o->dim, report.lastAllocating(), opt.steady);
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char **argv) {
+	Options opt;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-dim") == 0 && i + 1 < argc) {
+			opt.dims.push_back(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+			opt.threads = std::max(atoi(argv[++i]), 1);
+		}
+		else if (strcmp(argv[i], "-time") == 0 && i + 1 < argc) {
+			opt.minTime = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-filter") == 0 && i + 1 < argc) {
+			opt.filter = argv[++i];
+		}
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+			opt.out = argv[++i];
+		}
+		else if (strcmp(argv[i], "-path") == 0 && i + 1 < argc) {
+			opt.path = argv[++i];
+		}
+		else if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+			opt.frames = std::max(atoi(argv[++i]), 1);
+		}
+		else if (strcmp(argv[i], "-fps") == 0 && i + 1 < argc) {
+			opt.fps = std::max(atof(argv[++i]), 0.0);
+		}
+		else if (strcmp(argv[i], "-budget") == 0 && i + 1 < argc) {
+			opt.budget = std::max(atof(argv[++i]), 0.0);
+		}
+		else if (strcmp(argv[i], "-steady") == 0 && i + 1 < argc) {
+			opt.steady = std::max(atoi(argv[++i]), 0);
+		}
+		else {
+			fprintf(stderr, "usage: %s [-dim N]... [-threads N] [-time MS] [-filter TEXT] [-o FILE] "
+				"[-path NAME|FILE [-frames N] [-fps N] [-budget MS] [-steady N]]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (!opt.dims.size()) {
+		opt.dims.push_back(O_DIM);
+	}
+
+	CameraPath path;
+	if (!opt.path.empty() && !CameraPath::canned(opt.path, opt.frames, path) && !path.load(opt.path)) {
+		fprintf(stderr, "unknown camera path %s\n", opt.path.c_str());
+		return 1;
+	}
+
+	FILE *f = opt.out.empty() ? stdout : fopen(opt.out.c_str(), "w");
+	if (!f) {
+		fprintf(stderr, "could not open %s\n", opt.out.c_str());
+		return 1;
+	}
+	bool steady = true;
+	if (!opt.path.empty()) {
+		fprintf(f, "{\n  \"paths\": [");
+		for (size_t d = 0; d < opt.dims.size(); d++) {
+			fprintf(f, "%s\n    ", d ? "," : "");
+			steady = runPath(opt, path, opt.dims[d], f) && steady;
+		}
+		fprintf(f, "\n  ]\n}\n");
+	}
+	else {
+		vector<Result> results;
+		runNoise(opt, results);
+		for (size_t d = 0; d < opt.dims.size(); d++) {
+			runGrid(opt, opt.dims[d], results);
+		}
+		writeJson(f, opt, results);
+	}
+	if (f != stdout) {
+		fclose(f);
+	}
+	return steady ? 0 : 2;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#define ARENA_BLOCK (256 * 1024) // bytes an arena grows by at a time, more for a bigger request
+
+// Arena
+// @description
+// - Scratch memory for generation, handed out by bumping a pointer and given
+//   back in bulk: all of it by reset, or everything since a mark by rewind.
+//   Blocks are kept when memory is given back, so once an arena has grown to
+//   the most a frame needs it never goes to the heap again. Only for plain
+//   data, which is value-initialized like a vector's but never destroyed.
+//   An arena is not thread safe; jobs use their thread's own, see local.
+class Arena {
+public:
+	struct Mark {
+		size_t block; // block being allocated from
+		size_t used;  // bytes used in it
+	};
+
+	// Arena Scope
+	// @description
+	// - Gives back everything allocated after it was made when it goes out of
+	//   scope, for scratch that only lives as long as a function.
+	class Scope {
+	public:
+		explicit Scope(Arena &arena) : arena(arena), mark(arena.mark()) {}
+		~Scope() { arena.rewind(mark); }
+	private:
+		Arena &arena;
+		Mark mark;
+	};
+
+	Arena();
+	Arena(const Arena &) = delete;
+	Arena &operator=(const Arena &) = delete;
+	Mark mark() const;
+	void rewind(Mark to);
+	void reset();
+	void reserve(size_t bytes);
+	size_t capacity() const;
+	static Arena &local();
+
+	// Alloc Method
+	// @param
+	// - count: the number of values
+	// @description
+	// - Room for count values of a plain type, value-initialized.
+	template <class T>
+	T *alloc(size_t count) {
+		static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destroyed");
+		T *out = static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+		for (size_t k = 0; k < count; k++) {
+			new (out + k) T();
+		}
+		return out;
+	}
+private:
+	struct Block {
+		std::unique_ptr<char[]> data;
+		size_t size;
+	};
+	std::vector<Block> blocks;
+	Mark top; // where the next allocation goes
+
+	void *allocate(size_t bytes, size_t align);
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Camera Frame
+// @description
+// - Where the camera was for one frame of a path.
+struct CameraFrame {
+	glm::vec3 eye;
+	glm::vec3 look;
+	glm::vec3 up;
+};
+
+// Setting Change
+// @description
+// - A noise setting (see settings.h) that took a new value on a given frame,
+//   like a slider being dragged.
+struct SettingChange {
+	int frame;
+	int setting; // index into the table of settings in CameraPath.cpp
+	double value;
+};
+
+// Camera Path
+// @description
+// - A recorded or canned camera trajectory, plus any setting changes made
+//   along the way, for reproducible performance runs. Paths are saved as
+//   text, one line per frame ("frame ex ey ez lx ly lz ux uy uz") followed
+//   by "set name value" lines for the settings that changed on that frame.
+class CameraPath {
+public:
+	std::vector<CameraFrame> frames;
+	std::vector<SettingChange> changes;
+	void record(glm::vec3 eye, glm::vec3 look, glm::vec3 up);
+	bool apply(int frame) const;
+	bool save(const std::string &file) const;
+	bool load(const std::string &file);
+	static bool canned(const std::string &name, int count, CameraPath &out);
+private:
+	std::vector<double> snapshot; // setting values as of the last recorded frame
+};
@@ -0,0 +1,21 @@
+#pragma once
+#include <functional>
+#include <vector>
+
+// Climate Layer
+// @description
+// - A low-frequency scalar field (temperature, and later things like rainfall)
+//   that is only evaluated on a coarse lattice aligned to world coordinates
+//   and bilinearly upsampled onto the sector grid. The lattice is world
+//   aligned so the same location always gets the same value no matter which
+//   row, column or refresh produced it.
+class ClimateLayer {
+public:
+	typedef std::function<float(float x, float z)> Field;
+	ClimateLayer(float stride, Field field);
+	float sample(float x, float z) const;
+	void sampleGrid(const float *xs, int cols, const float *zs, int rows, float *out) const;
+private:
+	float stride; // world distance between lattice points
+	Field field;  // evaluates the full field at a world position
+};
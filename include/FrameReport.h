@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Frame Times
+// @description
+// - Milliseconds spent in each stage of one frame.
+struct FrameTimes {
+	double generate = 0.0; // Occulus::move or refresh
+	double mesh = 0.0;     // copying sector data into the attribute arrays
+	double upload = 0.0;   // handing the attribute arrays to GL
+	// GPU time of the upload, terrain and water passes (see GpuTimer). These
+	// come back a few frames late, so a frame gets the times that came back
+	// during it; -1 when none did, and always without a GL context.
+	double gpuUpload = -1.0;
+	double gpuTerrain = -1.0;
+	double gpuWater = -1.0;
+	long long allocations = -1; // heap allocations during the frame, -1 where nothing counts them
+};
+
+// Frame Report
+// @description
+// - Collects per-frame stage times over a run (usually a CameraPath replay)
+//   and writes their distribution as JSON, so two builds can be compared on
+//   the same trajectory.
+class FrameReport {
+public:
+	void add(const FrameTimes &t);
+	size_t size() const { return frames.size(); }
+	int lastAllocating() const;
+	void write(FILE *f, const std::string &path, int dim) const;
+private:
+	std::vector<FrameTimes> frames;
+};
+
+double percentile(const std::vector<double> &sorted, double p);
@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <vector>
+
+#define STATS_QUEUE 1024  // frame times in flight between the render and UI threads
+#define STATS_WINDOW 300  // frames the percentiles are taken over (~5s at 60fps)
+
+// Frame Summary
+// @description
+// - Frame rate and the distribution of frame times and GPU times, in frames
+//   per second and milliseconds.
+struct FrameSummary {
+	float fps = 0.0f;
+	float p50 = 0.0f;
+	float p95 = 0.0f;
+	float p99 = 0.0f;
+	float max = 0.0f;
+	float gpuP50 = 0.0f;
+	float gpuP95 = 0.0f;
+	float gpuP99 = 0.0f;
+	float gpuMax = 0.0f;
+};
+
+// Frame Stats
+// @description
+// - Frame timing service. The render thread reports each frame with frame(),
+//   which only writes to a single-producer / single-consumer lock-free queue.
+//   The reader (normally the UI thread, woken with Fl::awake when due()
+//   says so) drains the queue into a rolling window and summarizes it.
+class FrameStats {
+public:
+	explicit FrameStats(double cadence = 0.5);
+	void frame(float ms, float gpuMs = -1.0f);
+	bool due(double now);
+	FrameSummary summarize(double now);
+private:
+	// written by the render thread only
+	float queue[STATS_QUEUE];
+	float gpuQueue[STATS_QUEUE];
+	std::atomic<unsigned int> head;
+	double lastPush;
+
+	// written by the reader only
+	std::atomic<unsigned int> tail;
+	std::vector<float> window; // the last STATS_WINDOW frame times, oldest overwritten first
+	std::vector<float> gpuWindow; // the last STATS_WINDOW GPU times, oldest overwritten first
+	unsigned int windowNext;
+	unsigned int gpuNext;
+	unsigned int frames;       // frames since the last summary
+	double lastSummary;
+	double cadence;            // seconds between summaries
+};
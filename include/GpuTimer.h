@@ -0,0 +1,30 @@
+#pragma once
+#include <GL/glew.h>
+#include <vector>
+
+#define GPU_TIMER_LATENCY 4 // frames a query gets to finish before its result is read back
+
+// Gpu Timer
+// @description
+// - Pool of GL_TIME_ELAPSED queries for timing a fixed set of scopes (e.g.
+//   uploads, terrain, water) every frame. Each frame uses its own set of
+//   queries and results are only read GPU_TIMER_LATENCY frames later, when
+//   the set comes around again, and only if they are already available; a
+//   late result is dropped rather than waited for, so timing never stalls the
+//   pipeline. Scopes can't overlap. Needs a current GL 3.3 context.
+class GpuTimer {
+public:
+	explicit GpuTimer(int scopes);
+	~GpuTimer();
+	void beginFrame();
+	void begin(int scope);
+	void end();
+	bool read(float *ms);
+private:
+	int scopes;
+	int slot;                  // which set of queries this frame uses
+	std::vector<GLuint> queries; // GPU_TIMER_LATENCY sets of one query per scope
+	std::vector<bool> issued;  // query has been started since it was last read
+	std::vector<float> results; // latest milliseconds per scope
+	bool fresh;                // results changed since the last read
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+// Fixed Grid
+// @description
+// - Compile-time dimensions for a square view area grid. All index math folds
+//   to constants so loops over a fixed grid can be unrolled and vectorized by
+//   the compiler.
+template <int Dim>
+struct FixedGrid {
+	static constexpr int dim() { return Dim; }
+	static constexpr int count() { return Dim * Dim; }
+	static constexpr int min() { return -(Dim / 2); }
+	static constexpr int max() { return Dim - (Dim / 2); }
+	static constexpr int index(int i, int j) { return i * Dim + j; }
+};
+
+// Runtime Grid
+// @description
+// - Same interface as FixedGrid but with the dimension chosen at runtime. Used
+//   as the fallback when a view size has no compiled specialization.
+struct RuntimeGrid {
+	int n;
+	explicit RuntimeGrid(int dim) : n(dim) {}
+	int dim() const { return n; }
+	int count() const { return n * n; }
+	int min() const { return -(n / 2); }
+	int max() const { return n - (n / 2); }
+	int index(int i, int j) const { return i * n + j; }
+};
@@ -0,0 +1,64 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+
+// Height Bounds
+// @description
+// - Lowest and highest terrain height over some region. Empty (lo > hi) when
+//   the region has no terrain in the view area.
+struct HeightBounds {
+	float lo;
+	float hi;
+	bool empty() const { return lo > hi; }
+};
+
+// Height Pyramid
+// @description
+// - Min/max mip pyramid over the view area's heightfield, for ray casts and
+//   region bounds without scanning the map. Level 0 holds one node per grid
+//   cell (the quad between four sectors) and each level above halves the
+//   resolution up to a single root.
+// - Cells are addressed by world grid coordinates and stored toroidally in a
+//   power of two square at least as wide as the view, so when the view area
+//   shifts only the row or column leaving and the one arriving change; the
+//   rest of the pyramid stays where it is. Cells outside the view are empty.
+// - Changes are queued by moveTo and set and applied by flush, which only
+//   recomputes the nodes above the cells that changed, so a view area that
+//   moves every frame but is seldom queried only pays for the queries. After
+//   a reset the next flush rebuilds everything instead.
+class HeightPyramid {
+public:
+	HeightPyramid();
+	void resize(int dim, float spacing);
+	void reset(int gx, int gz, glm::vec2 offset);
+	void moveTo(int gx, int gz, glm::vec2 offset);
+	void set(int gx, int gz, float height);
+	void flush();
+	HeightBounds bounds(int gx0, int gz0, int gx1, int gz1) const;
+	HeightBounds regionBounds(glm::vec2 lo, glm::vec2 hi) const;
+	bool raycast(glm::vec3 origin, glm::vec3 dir, float maxDist, float &t) const;
+	glm::ivec2 origin() const { return glm::ivec2(originX, originZ); }
+private:
+	int dim;           // sectors along each side of the view area
+	int side;          // power of two the grid coordinates wrap at
+	int top;           // index of the root level
+	float spacing;     // world distance between sectors
+	int originX, originZ; // grid coordinates of the view area's first sector
+	glm::vec2 offset;  // world position of grid coordinate 0, 0
+	std::vector<float> heights; // per sector, by wrapped grid coordinates
+	std::vector<std::vector<HeightBounds> > levels; // per level, side >> level nodes square
+	std::vector<int> pending;   // sectors changed since the last flush
+	std::vector<char> touched;  // per sector, whether it is in pending
+	std::vector<std::vector<char> > queued; // per level, whether a node is already in a flush list
+	bool stale;                 // the whole pyramid needs rebuilding
+
+	int wrap(int g) const { return g & (side - 1); }
+	int node(int level, int gx, int gz) const;
+	bool inView(int gx, int gz) const;
+	void touch(int gx, int gz);
+	void unqueue();
+	void rebuild();
+	HeightBounds leaf(int idx) const;
+	void query(int level, int bx, int bz, int gx0, int gz0, int gx1, int gz1, HeightBounds &out) const;
+	bool hitCell(int gx, int gz, glm::vec3 origin, glm::vec3 dir, float maxT, float &t) const;
+};
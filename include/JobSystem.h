@@ -0,0 +1,128 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#define JOB_BACKGROUND 1.0e6f // added to the priority of work no frame waits for
+#define JOB_TASK_BYTES 64     // most a task's captures may take, they are kept in the job itself
+#define JOB_QUEUE_RESERVE 512 // jobs each queue has room for before it has to grow
+
+// Job Group
+// @description
+// - Jobs that are waited for, or cancelled, together. Jobs of a cancelled
+//   group that have not started are skipped; ones already running finish.
+//   A group must outlive its jobs, so wait for it before destroying it.
+class JobGroup {
+public:
+	JobGroup() : pending(0), cancelled(false) {}
+	void cancel() { cancelled.store(true); }
+	bool isCancelled() const { return cancelled.load(); }
+	bool done() const { return pending.load() == 0; }
+	void reuse() { cancelled.store(false); } // only once done
+private:
+	friend class JobSystem;
+	std::atomic<int> pending;    // jobs submitted and not yet finished or skipped
+	std::atomic<bool> cancelled;
+};
+
+// Job System
+// @description
+// - A fixed pool of workers for generation work. Each worker has its own
+//   queue, kept in priority order with the most urgent job (the lowest
+//   priority value) at the back, and submissions are spread over the queues
+//   in turn. A worker takes from the back of its own queue and, once that is
+//   empty, steals the most urgent job of the others, so no worker sits idle
+//   while another has a backlog.
+// - A thread waiting for a group runs that group's queued jobs itself rather
+//   than sleeping, so a frame never waits behind background work.
+// - Submitting doesn't touch the heap once the queues have grown to their
+//   busiest: tasks are kept inline rather than in a std::function, which
+//   allocates for more than a couple of captures.
+class JobSystem {
+public:
+	// Task
+	// @description
+	// - A callable of up to JOB_TASK_BYTES, usually a lambda, stored in place.
+	class Task {
+	public:
+		Task() : invoke(nullptr), relocate(nullptr), destroy(nullptr) {}
+		template <class F, class = typename std::enable_if<!std::is_same<typename std::decay<F>::type, Task>::value>::type>
+		Task(F &&f) {
+			typedef typename std::decay<F>::type Fn;
+			static_assert(sizeof(Fn) <= JOB_TASK_BYTES, "task captures too much, raise JOB_TASK_BYTES");
+			static_assert(alignof(Fn) <= alignof(std::max_align_t), "task is over-aligned");
+			new (storage) Fn(std::forward<F>(f));
+			invoke = [](void *fn) { (*static_cast<Fn *>(fn))(); };
+			relocate = [](void *to, void *from) {
+				new (to) Fn(std::move(*static_cast<Fn *>(from)));
+				static_cast<Fn *>(from)->~Fn();
+			};
+			destroy = [](void *fn) { static_cast<Fn *>(fn)->~Fn(); };
+		}
+		Task(Task &&other) noexcept : invoke(nullptr), relocate(nullptr), destroy(nullptr) {
+			*this = std::move(other);
+		}
+		Task &operator=(Task &&other) noexcept {
+			if (this != &other) {
+				clear();
+				if (other.invoke) {
+					other.relocate(storage, other.storage);
+					invoke = other.invoke;
+					relocate = other.relocate;
+					destroy = other.destroy;
+					other.invoke = nullptr;
+				}
+			}
+			return *this;
+		}
+		~Task() { clear(); }
+		void operator()() { invoke(storage); }
+		void clear() {
+			if (invoke) {
+				destroy(storage);
+				invoke = nullptr;
+			}
+		}
+	private:
+		alignas(std::max_align_t) unsigned char storage[JOB_TASK_BYTES];
+		void (*invoke)(void *fn);
+		void (*relocate)(void *to, void *from);
+		void (*destroy)(void *fn);
+	};
+
+	explicit JobSystem(int workers = 0);
+	~JobSystem();
+	void submit(JobGroup &group, float priority, Task task);
+	void wait(JobGroup &group);
+	int workers() const;
+private:
+	struct Job {
+		float priority;
+		JobGroup *group;
+		Task task;
+	};
+	struct Queue {
+		std::mutex lock;
+		std::vector<Job> jobs; // most urgent last, taken from the back
+	};
+	std::vector<std::unique_ptr<Queue> > queues; // one per worker
+	std::vector<std::thread> threads;
+	std::atomic<unsigned int> next;   // queue the next submission goes to
+	std::atomic<int> queued;          // jobs waiting in all the queues
+	std::mutex sleep;                 // guards stopping and the waits below
+	std::condition_variable wake;     // signalled when jobs are queued or on shutdown
+	std::condition_variable finished; // signalled when a group's last job finishes
+	bool stopping;
+
+	bool pop(int home, Job &job);
+	bool popGroup(JobGroup &group, Job &job);
+	void run(Job &job);
+	void work(int index);
+};
@@ -1,18 +1,28 @@
 #pragma once
-#define C_DIM 16
+#define C_DIM 16   // sectors along each side of a mesh chunk
 #define O_NUM 20
-#define O_DIM C_DIM * O_NUM
-#define O_MIN -(O_DIM / 2)
-#define O_MAX (O_DIM / 2)
-#define UVX_MIN 0.0
-#define UVX_MAX 0.24
-#define UVY_MIN 0.0
-#define UVY_MAX 0.50
+#define O_DIM (C_DIM * O_NUM) // default view size, also the noise frequency scale
+#define WATER_STEP 4        // sectors spanned by each water quad
+#define WATER_MARGIN 0.05f  // height of the tallest wave crest above sea level
+#define PLACEHOLDER_STEP 4  // sectors between the samples of the coarse map shown after a jump
+#define FLAT_HEIGHT 1.0e-6f // summed octaves at or below this are flat, keeps the power curve finite
+#define STALE_COMBINE 1     // row needs its octaves brought to its level of detail and recombined
+#define STALE_NOISE 2       // row's baked noise is out of date
+#define STALE_CLIMATE 4     // row's base temperatures are out of date
+#define STARTUP_ROWS (C_DIM * 2) // rows nearest the center built before the first frame when streaming
 
 #include "OpenSimplex.h"
 #include "settings.h"
 #include "Sector.h"
-#include <map>
+#include "Grid.h"
+#include "ClimateLayer.h"
+#include "OctaveTiles.h"
+#include "HeightPyramid.h"
+#include "ResidentMap.h"
+#include "JobSystem.h"
+#include "Prefetcher.h"
+#include "Arena.h"
+#include <chrono>
 #include <vector>
 #include<glm/glm.hpp>
 #include <iterator>
@@ -21,6 +31,8 @@
 #include <mutex>
 #include <iostream>
 
+static_assert((C_DIM + 1) * (C_DIM + 1) <= 65536, "chunk vertices must fit 16-bit indices");
+
 using glm::cross;
 using std::vector;
 using glm::vec3;
@@ -31,32 +43,111 @@ using std::tuple;
 using std::get;
 
 class Occulus {
+	friend class Bench; // bench/bench.cpp times the private stages directly
 public:
 	vec3 position;
 	float size;
+	int dim;
 	vector<Sector> map;
 	Occulus();
 	Occulus(float x, float y, float z);
 	Occulus(vec3 pos);
+	Occulus(vec3 pos, int viewDim, double budgetMs = 0.0);
+	virtual ~Occulus() {}
+	static Occulus *create(vec3 pos, int viewDim = O_DIM, double budgetMs = 0.0);
 	void draw(vector<vec4> &vertices, vector<vec4> &normals, vector<vec2> &uvs,
 		vector<float> &temps, vector<float> &heights, vector<uvec3> &faces);
 	void drawWater(vector<vec4> &vertices, vector<vec2> &uvs, vector<uvec3>&faces);
-	void update(vec3 pos, vector<float> &heights, vector<vec4> &normals, vector<float> &temps, vector<uvec3> &faces);
-	void refresh();
+	void waterChunks(float level, vector<int> &chunks);
+	int chunksPerSide() const;
+	int chunkSize() const;
+	int waterChunkSize() const;
+	bool raycast(vec3 origin, vec3 dir, float maxDist, vec3 &hit);
+	HeightBounds regionBounds(vec2 lo, vec2 hi);
+	float sampleHeight(float x, float z) const;
+	float sampleTemp(float x, float z) const;
+	void sample(const vec2 *points, int count, float *heights, float *temps) const;
+	void update(vec3 pos, vector<float> &heights, vector<vec4> &normals, vector<float> &temps);
+	void move(vec3 pos);
+	void setBudget(double ms);
+	bool settled() const;
+	void draw(vector<vec4> &normals, vector<float> &temps, vector<float> &heights);
+	virtual void refresh();
+protected:
+	virtual void shift(int zDir, int xDir);
+	template <class Grid> void shiftMap(const Grid &grid, int zDir, int xDir);
+	template <class Grid> void refreshMap(const Grid &grid);
+	template <class Grid> void combineMap(const Grid &grid, int i0, int rows);
+	template <class Grid> void mapBands(const Grid &grid, bool climate, bool reset);
+	template <class Grid> void mapRow(const Grid &grid, int i, unsigned char stale);
+	void updateLod();
+	NoiseShape noiseShape() const;
 private:
 	float spacing;
+	ClimateLayer temperature; // coarse temperature field, before altitude correction
 	void initMap();
 	void updateMap();
-	tuple<float, float> mapNoise(vec3 pos);
+	void regenerate();
+	void refillLookups();
+	void placeholder();
+	void markStale(unsigned char flags);
+	void shiftStale(int zDir);
+	void catchUp(std::chrono::steady_clock::time_point start, int minRows = 0);
+	void trackRows(const int *rows, int count);
+	void trackLookups(int zDir, int xDir);
+	void prefetchAhead();
+	void bakeLine(PrefetchLine &line);
+	bool takeLine(int axis, int slot, vector<Sector> &out, OctaveTiles &outTiles);
+	void evaluate(const NoiseShape &shape, const vec2 *points, int count, float *heights, float *temps) const;
+	void mapNoise(Sector &sec, OctaveTiles &out, int idx, unsigned int lod);
+	void combine(Sector &sec, const OctaveTiles &in, int idx);
+	bool bakeChanged();
+	float temperatureNoise(float x, float z);
+	void mapClimate(int i0, int rows, int j0, int cols, Sector *out);
+	vec3 slotPosition(int i, int j);
+	float jobPriority(int i0, int rows, int j0, int cols) const;
+	OctaveTiles tiles; // raw noise of every sector in the map, same layout as map
+	float bakedFx[OCTAVES], bakedFz[OCTAVES]; // frequencies the tiles were baked at
+	double bakedLodPixels; // lodPixels the level of detail targets were built for
+	vector<unsigned int> lodTarget; // packed octave weight levels for each slot of the grid
+	vector<int> lodEdges[9]; // per direction of motion, slots whose level differs from their source
 	vector<vec4> nIndex; // TODO: Delete this once indexed vertices are implemented
-	vector<int> indexes;
+	vector<int> indexes; // sector behind each vertex of the terrain mesh
+	HeightPyramid pyramid; // min/max heights of the map, for ray and region queries
+	ResidentMap resident;  // heights and temperatures of the map, for sampling from any thread
+	glm::ivec2 gridOrigin; // world grid coordinates of slot 0, 0
 	struct osn_context *ctx;
 	vec3 lPosition;
-	vec4 calcNormal(vec3 p1, vec3 p2, vec3 p3);
-	void draw(vector<vec4> &normals, vector<float> &temps, vector<float> &heights, vector<uvec3> &faces);
+	vec3 lRawPosition; // position passed to the last move, before snapping
+	vec2 velocity;     // smoothed x, z motion in cells per move
+	double budget = 0.0;            // milliseconds of generation per frame, 0 for no limit
+	vector<unsigned char> staleRows; // per row of slots, the STALE_ flags of work put off by the budget
+	int staleCount = 0;             // rows with any flag set
+	// scratch kept between frames so a steady frame doesn't touch the heap
+	Arena frame;                    // reset at the start of every move and refresh
+	vector<Sector> edgeRow, edgeCol; // new row and column of a shift
+	OctaveTiles edgeRowTiles, edgeColTiles;
+	OctaveTiles sampleTiles;        // raw noise of the placeholder's samples
+	vector<PrefetchLine> wantLines; // lines asked of the prefetcher, without their data
+	PrefetchLine takenLine;         // the last prefetched line taken, its buffers go back to the prefetcher
 	int calcFlags();
-	void runGenRow();
-	void runGenCol();
-	void genRow(int flags, vector<tuple<float, float>> &row);
-	void genCol(int flags, vector<tuple<float, float>> &col);
-};
\ No newline at end of file
+	void genRow(JobGroup &group, int flags, vector<Sector> &row, OctaveTiles &rowTiles);
+	void genCol(JobGroup &group, int flags, vector<Sector> &col, OctaveTiles &colTiles);
+	JobSystem jobs;      // near the end, so its workers stop before anything they read is destroyed
+	Prefetcher prefetch; // after jobs, it waits for its own jobs when destroyed
+};
+
+// Fixed Occulus
+// @description
+// - View area whose dimensions are known at compile time. The per-frame map
+//   shift and the refresh pass are instantiated against a FixedGrid so their
+//   index math is constant. Create through Occulus::create, which falls back
+//   to the runtime-sized base class for sizes without a specialization.
+template <int Dim>
+class FixedOcculus : public Occulus {
+public:
+	FixedOcculus(vec3 pos, double budgetMs = 0.0) : Occulus(pos, Dim, budgetMs) {}
+	void refresh() override;
+protected:
+	void shift(int zDir, int xDir) override;
+};
@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+#include <cstring>
+#include "Sector.h"
+
+// Octave Tiles
+// @description
+// - Raw noise baked per octave into float tiles: one tile for each octave's
+//   value and one for each of its derivatives, all laid out like the sector
+//   map. Keeping the octaves out of the sectors as plain float arrays lets the
+//   combine pass run as straight vectorizable loops, and lets refreshes that
+//   only touch post-processing parameters skip noise evaluation entirely.
+struct OctaveTiles {
+	std::vector<float> value[OCTAVES]; // raw value of each octave
+	std::vector<float> dx[OCTAVES];    // derivative along x, in noise coordinates
+	std::vector<float> dz[OCTAVES];    // derivative along z, in noise coordinates
+
+	static const int TILES = OCTAVES * 3;
+
+	// Tile Method
+	// @param
+	// - t: the tile number, 0 to TILES - 1
+	// @description
+	// - Walks every tile regardless of what it holds, for moving data around.
+	std::vector<float> &tile(int t) {
+		return t < OCTAVES ? value[t] : (t < OCTAVES * 2 ? dx[t - OCTAVES] : dz[t - OCTAVES * 2]);
+	}
+
+	void resize(int count) {
+		for (int t = 0; t < TILES; t++) {
+			tile(t).assign(count, 0.0f);
+		}
+	}
+	void set(int k, int idx, float v, float ddx, float ddz) {
+		value[k][idx] = v;
+		dx[k][idx] = ddx;
+		dz[k][idx] = ddz;
+	}
+	void copy(int idx, OctaveTiles &from, int fromIdx) {
+		for (int t = 0; t < TILES; t++) {
+			tile(t)[idx] = from.tile(t)[fromIdx];
+		}
+	}
+};
@@ -42,6 +42,7 @@ extern "C" {
 	void open_simplex_noise_free(struct osn_context *ctx);
 	int open_simplex_noise_init_perm(struct osn_context *ctx, int16_t p[], int nelements);
 	double open_simplex_noise2(struct osn_context *ctx, double x, double y);
+	double open_simplex_noise2_deriv(struct osn_context *ctx, double x, double y, double *dx, double *dy);
 	double open_simplex_noise3(struct osn_context *ctx, double x, double y, double z);
 	double open_simplex_noise4(struct osn_context *ctx, double x, double y, double z, double w);
 
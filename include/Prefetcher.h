@@ -0,0 +1,75 @@
+#pragma once
+#include "OctaveTiles.h"
+#include "JobSystem.h"
+#include <glm/glm.hpp>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define PREFETCH_AHEAD 4          // most lines generated ahead of the view along each axis
+#define PREFETCH_LINES (PREFETCH_AHEAD * 2) // most lines kept, queued or being generated at once
+#define PREFETCH_MARGIN 8         // extra sectors at each end of a line, room to drift sideways
+#define PREFETCH_LEAD 8.0f        // updates of warning wanted before a line is needed
+#define PREFETCH_MIN_SPEED 0.02f  // cells per update below which nothing is prefetched
+#define PREFETCH_SMOOTHING 0.25f  // weight of the latest move in the smoothed velocity
+
+// Prefetch Line
+// @description
+// - A row or column of sectors generated ahead of the view area, addressed by
+//   world grid coordinates: each sector's base temperature and the raw noise
+//   of every octave, ready for combine. A line holds every octave so it fits
+//   whatever level of detail the slot it lands in wants.
+struct PrefetchLine {
+	int axis;          // 0 for a row (fixed grid z), 1 for a column (fixed grid x)
+	int line;          // grid z of a row, grid x of a column
+	int start;         // grid coordinate of the first sector along the line
+	int length;        // sectors along the line
+	glm::vec2 offset;  // world position of grid coordinate 0, 0
+	float spacing;     // world distance between sectors
+	float fx[OCTAVES], fz[OCTAVES]; // octave frequencies to bake with
+	std::vector<float> baseTemp;
+	OctaveTiles tiles;
+
+	bool covers(int axis, int line, int start, int length) const {
+		return this->axis == axis && this->line == line &&
+			this->start <= start && this->start + this->length >= start + length;
+	}
+};
+
+// Prefetcher
+// @description
+// - Generates lines as background jobs before the view area reaches them, so
+//   a shift can take its new row or column ready made instead of waiting on
+//   the noise. The owner says which lines it wants after every move; jobs for
+//   lines it stops wanting are cancelled, queued or baked lines are dropped,
+//   and at most PREFETCH_LINES are held at once. The bake callback does the
+//   actual generation and must be safe to call from the job workers.
+// - Lines are pooled: all PREFETCH_LINES are made up front, sized by
+//   reserve, and a finished or taken line goes back to a spare list with its
+//   buffers, so a steady stream of lines doesn't touch the heap.
+class Prefetcher {
+public:
+	typedef std::function<void(PrefetchLine &line)> Bake;
+	Prefetcher(JobSystem &jobs, Bake bake);
+	~Prefetcher();
+	void reserve(int length);
+	void want(const std::vector<PrefetchLine> &lines);
+	bool take(int axis, int line, int start, int length, PrefetchLine &out);
+	void invalidate();
+	static void sizeLine(PrefetchLine &line, int length);
+private:
+	struct Pending {
+		PrefetchLine line;
+		JobGroup job; // the line is baked once this is done
+	};
+	JobSystem &jobs;
+	Bake bake;
+	std::mutex lock; // guards held and dropped
+	std::vector<std::unique_ptr<Pending> > held;    // wanted lines, queued, baking or baked
+	std::vector<std::unique_ptr<Pending> > dropped; // cancelled lines whose job may still be running
+	std::vector<std::unique_ptr<Pending> > spare;   // lines done with, kept for their buffers
+
+	void drop(size_t idx);
+	void reap();
+};
@@ -0,0 +1,23 @@
+#pragma once
+#include <GL/glew.h>
+#include <string>
+
+// Program Cache
+// @description
+// - On-disk cache of linked program binaries (ARB_get_program_binary), so a
+//   warm start skips compiling and linking the shaders. Entries are keyed by a
+//   hash of the shader sources together with the GL vendor, renderer and
+//   version strings, so an edited shader or a driver update just misses.
+// - Any failure (no extension, no binary formats, missing or stale file, a
+//   binary the driver rejects) shows up as a miss and the caller compiles
+//   from source as usual. Needs a current GL context.
+class ProgramCache {
+public:
+	explicit ProgramCache(const std::string &dir);
+	bool load(GLuint program, const char *const *sources, int count);
+	void store(GLuint program, const char *const *sources, int count);
+private:
+	std::string dir;
+	bool supported;
+	std::string path(const char *const *sources, int count) const;
+};
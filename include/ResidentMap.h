@@ -0,0 +1,57 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <atomic>
+#include <memory>
+#include "Sector.h"
+
+// Noise Shape
+// @description
+// - The parameters the generator combines the noise with, published along
+//   with the resident map so a reader evaluating the noise outside it uses
+//   the set its sectors were built with, never one being changed under it.
+struct NoiseShape {
+	float heightPow;
+	float maxH;
+	float amp[OCTAVES], fx[OCTAVES], fz[OCTAVES];
+};
+
+// Resident Map
+// @description
+// - Copy of the heights and temperatures of the view area's sectors that any
+//   thread can sample while the generator keeps moving the view. Sectors are
+//   addressed by world grid coordinates and stored toroidally, like the
+//   height pyramid, so a move only rewrites the row and column that came into
+//   view and the sectors whose level of detail changed.
+// - Guarded by a sequence lock: the generator bumps the sequence around each
+//   batch of writes and readers retry if it changed under them. Readers never
+//   take a lock, so any number of them can sample without holding up the
+//   generator; at worst a reader repeats a lookup. The noise shape is
+//   published under the same sequence.
+class ResidentMap {
+public:
+	ResidentMap();
+	void resize(int dim, float spacing);
+	void beginWrite();
+	void endWrite();
+	void place(int gx, int gz, glm::vec2 offset);
+	void set(int gx, int gz, float height, float temp);
+	void setShape(const NoiseShape &shape);
+	int sample(const glm::vec2 *points, int count, float *heights, float *temps,
+		NoiseShape *shape = nullptr) const;
+private:
+	static const int SHAPE_VALUES = sizeof(NoiseShape) / sizeof(float);
+	struct Slot {
+		std::atomic<float> height;
+		std::atomic<float> temp;
+	};
+	int dim;        // sectors along each side of the view area
+	int side;       // power of two the grid coordinates wrap at
+	float spacing;  // world distance between sectors
+	std::unique_ptr<Slot[]> slots;        // per sector, by wrapped grid coordinates
+	std::atomic<unsigned int> sequence;   // odd while a write is in progress
+	std::atomic<int> originX, originZ;    // grid coordinates of the view area's first sector
+	std::atomic<float> offsetX, offsetZ;  // world position of grid coordinate 0, 0
+	std::atomic<float> shapeValues[SHAPE_VALUES]; // the noise shape, a float at a time
+
+	bool lookup(glm::vec2 p, glm::vec2 offset, glm::ivec2 origin, float &height, float &temp) const;
+};
@@ -1,18 +1,43 @@
 #pragma once
 #include<glm/glm.hpp>
+#include<cstring>
+
+#define OCTAVES 4      // three height octaves plus the sea bed
+#define SEA_OCTAVE 3   // index of the sea bed octave
+#define LOD_LEVELS 16  // weight steps used when fading an octave out with distance
+#define LOD_FULL 0x10101010u // every octave at full weight
+
+// Lod Level
+// @description
+// - Extracts the weight level (0 to LOD_LEVELS) of one octave from a packed
+//   lod value, which holds one byte per octave.
+inline int lodLevel(unsigned int lod, int octave) {
+	return (lod >> (octave * 8)) & 0xFF;
+}
 
 struct Sector {
 	glm::vec3 position = glm::vec3(0.0, 0.0, 0.0);
 	float temp;
+	glm::vec3 normal = glm::vec3(0.0, 1.0, 0.0);
 	const float size = 0.25;
+
+	// raw octaves live in the Occulus' OctaveTiles, these say which of them are usable
+	float baseTemp;                 // temperature before altitude correction
+	unsigned int lod = 0;           // weight level each octave was combined with
+	unsigned int evaluated = 0;     // bit per octave with a valid raw value
+
 	void init(float x, float y, float z) {
 		position = glm::vec3(x, y, z);
 	}
 	void init(glm::vec3 pos) {
 		position = pos;
 	}
-	void copy(Sector newSect) {
+	void copy(const Sector &newSect) {
 		position.y = newSect.position.y;
 		temp = newSect.temp;
+		normal = newSect.normal;
+		baseTemp = newSect.baseTemp;
+		lod = newSect.lod;
+		evaluated = newSect.evaluated;
 	}
-};
\ No newline at end of file
+};
@@ -0,0 +1,57 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#define TRACE_RING 16384 // events kept per thread, older ones are overwritten
+
+// Trace Zone macro
+// - Times the rest of the enclosing scope under the given name (a string
+//   literal). Costs one relaxed load when tracing is off; define NO_TRACE to
+//   compile zones out entirely.
+#ifdef NO_TRACE
+#define TRACE_ZONE(name)
+#else
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(traceZone, __LINE__)(name)
+#endif
+
+// Trace
+// @description
+// - Low-overhead scoped timing. Each thread records finished zones into its
+//   own ring buffer, so the hot path takes no locks; a lock is only taken
+//   when a thread records its first zone, when it exits, and when exporting.
+//   Rings of finished threads are handed to the next new thread, so the
+//   per-frame worker threads don't grow memory. Tracing can be switched on
+//   and off at runtime and exported as Chrome trace-event JSON (load it in
+//   chrome://tracing or Perfetto).
+class Trace {
+public:
+	static void enable(bool state);
+	static bool enabled() { return on.load(std::memory_order_relaxed); }
+	static void nameThread(const char *name);
+	static void clear();
+	static bool write(const std::string &file);
+	static int64_t now();
+	static void record(const char *name, int64_t start, int64_t end);
+private:
+	static std::atomic<bool> on;
+};
+
+// Trace Zone
+// @description
+// - Records the time between its construction and destruction. Use through
+//   TRACE_ZONE.
+class TraceZone {
+public:
+	explicit TraceZone(const char *name) : name(name), start(Trace::enabled() ? Trace::now() : -1) {}
+	~TraceZone() {
+		if (start >= 0) {
+			Trace::record(name, start, Trace::now());
+		}
+	}
+private:
+	const char *name;
+	int64_t start;
+};
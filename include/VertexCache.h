@@ -0,0 +1,20 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+
+#define VCACHE_SIZE 32 // post-transform cache entries the face order is tuned for
+
+// Vertex Cache Stats
+// @description
+// - How well a face order reuses the post-transform vertex cache, from a FIFO
+//   cache simulation. acmr is cache misses per triangle (0.5 is the best a
+//   regular grid can do, 3 means no reuse at all); atvr is misses per vertex
+//   referenced (1 means every vertex is transformed exactly once).
+struct VertexCacheStats {
+	float acmr;
+	float atvr;
+};
+
+void optimizeFaces(std::vector<glm::uvec3> &faces, int vertexCount);
+VertexCacheStats vertexCacheStats(const std::vector<glm::uvec3> &faces, int vertexCount,
+	int cacheSize = VCACHE_SIZE);
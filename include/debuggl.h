@@ -2,6 +2,16 @@
 #define DEBUGGL_H
 #include "portable_gl.h"
 
+// GL error reporting mode
+// - By default errors are reported through the KHR_debug message callback
+//   (see DebugGLEnableOutput), which is asynchronous in release builds and
+//   synchronous in debug builds (when NDEBUG is not defined), and
+//   CHECK_GL_ERROR compiles down to the bare statement so hot loops pay
+//   nothing.
+// - Define DEBUGGL_GETERROR to go back to a synchronous glGetError after
+//   every wrapped call, for drivers without KHR_debug.
+// - The shader and program checks below report their logs in both modes.
+
 #define CHECK_SUCCESS(x)   \
   do {                     \
     if (!(x)) {            \
@@ -45,6 +55,7 @@
     }                                                                        \
   } while (0)
 
+#ifdef DEBUGGL_GETERROR
 #define CHECK_GL_ERROR(statement)                                             \
   do {                                                                        \
     { statement; }                                                            \
@@ -56,7 +67,14 @@
       exit(EXIT_FAILURE);                                                     \
     }                                                                         \
   } while (0)
+#else
+#define CHECK_GL_ERROR(statement) \
+  do {                            \
+    { statement; }                \
+  } while (0)
+#endif
 
 const char* DebugGLErrorToString(int error);
+bool DebugGLEnableOutput();
 
 #endif
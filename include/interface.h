@@ -11,7 +11,9 @@
 #include <glm/gtx/string_cast.hpp>
 #include <math.h>
 #include <thread>
+#include <chrono>
 #include <stdlib.h> /* atoi */
+#include <string.h> /* strcmp */
 
 // OpenGL library includes
 #include <Windows.h>
@@ -22,6 +24,12 @@
 // Project includes
 #include "Occulus.h"
 #include "Camera.h"
+#include "CameraPath.h"
+#include "FrameReport.h"
+#include "Trace.h"
+#include "FrameStats.h"
+#include "GpuTimer.h"
+#include "ProgramCache.h"
 #include "debuggl.h"
 
 // GUI Libraries
@@ -44,31 +52,6 @@ using std::cout;
 using std::endl;
 using std::numeric_limits;
 
-// Init settings
-double seaLevel = 1.0;
-
-// Elevation settings
-double height1a = 1.0;
-double height1b = 10.0;
-double height1c = 10.0;
-double height2a = 0.5;
-double height2b = 20.0;
-double height2c = 20.0;
-double height3a = 0.25;
-double height3b = 50.0;
-double height3c = 30.0;
-
-// Raise elevation by power
-double heightPow = 2.33334;
-
-// sea level settings
-double slHeighta = 0.25;
-double slHeightb = 5.0;
-double slHeightc = 5.0;
-
-// multiplier
-double maxH = 20.001;
-
 // Define statements
 #define PRESS_W key == GLFW_KEY_W && action != GLFW_RELEASE
 #define PRESS_A key == GLFW_KEY_A && action != GLFW_RELEASE
@@ -99,12 +82,25 @@ float aspect = 0.0f;
 
 // Grid variable
 bool setRefresh = false;
+int viewDim = O_DIM; // number of sectors along each side of the view area, set with -view
+double genBudget = 6.0; // milliseconds of terrain generation per frame, set with -budget (0 for no limit)
+
+// Camera path variables
+std::string recordFile; // -record: save the camera path flown to this file on exit
+std::string replayName; // -replay: fly a canned path or a recorded file instead of taking input
+std::string reportFile; // -report: where to write the replay's frame times (default stdout)
+int replayFrames = 600; // -frames: length of canned paths
+CameraPath cameraPath;
+FrameReport frameReport;
+
+// Trace variables
+std::string traceFile = "trace.json"; // where F2 (or -trace FILE) writes the captured trace
 
 // UI Variables
-int fps = 0;
-bool running = true; // used for threading UI updates
+FrameStats frameStats; // fed by the render thread, summarized on the UI thread
 Fl_Window *mainWindow = new Fl_Window(120, 400, "Settings"); // Main window for settings toolbar
 Fl_Box *box = new Fl_Box(10, 40, 100, 40, "###"); // Box which holds the FPS counter
+Fl_Box *frameTimesBox = new Fl_Box(10, 130, 100, 75, ""); // frame time percentiles under the buttons
 
 double slWidth = 400.0;
 double slHeight = 80.0;
@@ -183,11 +179,21 @@ vector<float> tHeights;
 vector<vec4> tNormals;
 vector<uvec3> tFaces;
 vector<vec2> tUv;
+vector<GLsizei> tCounts; // glMultiDrawElementsBaseVertex arguments for the terrain chunks
+vector<const GLvoid*> tOffsets;
+vector<GLint> tBaseVertices;
 
 // Water Shader Variables
 vector<vec4> wVertices;
 vector<uvec3> wFaces;
 vector<vec2> wUV;
+vector<int> wChunks; // water chunks drawn this frame
+vector<GLsizei> wCounts; // glMultiDrawElementsBaseVertex arguments for those chunks
+vector<const GLvoid*> wOffsets;
+vector<GLint> wBaseVertices;
+
+// Terrain chunk faces followed by water chunk faces, as 16-bit indices
+vector<GLushort> sharedIndices;
 
 // Create the camera
 Camera camera = Camera(3.0);
@@ -219,10 +225,54 @@ enum { kVertexBuffer, kNormalBuffer, kTempBuffer, kHeightBuffer, kUVBuffer, kInd
 // VAOs
 enum { kGeometryVao, kWaterVao, kNumVaos };
 
+// GPU timer scopes
+enum { kGpuUpload, kGpuTerrain, kGpuWater, kNumGpuScopes };
+
+// Uniform buffer binding points
+enum { kFrameBlock, kNumBlocks };
+
+// Frame Uniforms
+// @description
+// - CPU side of the std140 Frame block in main.cpp's shaders: matrices and
+//   vec4s sit on 16 byte boundaries and the four scalars pack into the last
+//   vec4 slot, so the struct can be copied into the buffer as is.
+struct FrameUniforms {
+	mat4 projection;
+	mat4 view;
+	vec4 lPos;
+	vec4 cPos;
+	vec4 sceneCol;
+	float fogDist;
+	float ambConst;
+	float seaLev;
+	int time;
+};
+static_assert(sizeof(FrameUniforms) == 192, "FrameUniforms must match the std140 Frame block");
+
 //Variables to hold VAO and VBO descriptors
 GLuint gArrayObjects[kNumVaos]; // Holds VAO descriptors
 GLuint gBufferObjects[kNumVaos][kNumVbos]; // Holds VBO descriptors
 
+// Toggle Trace Function
+// @description
+// - Starts a fresh capture of the timing zones, or stops the current one and
+//   writes it to traceFile as Chrome trace JSON.
+void toggleTrace() {
+	if (!Trace::enabled()) {
+		Trace::clear();
+		Trace::enable(true);
+	}
+	else {
+		Trace::enable(false);
+		if (Trace::write(traceFile)) {
+			std::cout << "Trace written to " << traceFile << "\n";
+		}
+		else {
+			std::cerr << "Could not write trace to " << traceFile << "\n";
+		}
+	}
+}
+
 // Begin key callbacks and camera controls
 void KeyCallback(GLFWwindow* window,
 	int key,
@@ -232,6 +282,8 @@ void KeyCallback(GLFWwindow* window,
 {
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, GL_TRUE);
+	else if (key == GLFW_KEY_F2 && action == GLFW_PRESS)
+		toggleTrace();
 	else if (PRESS_W) {
 			camera.setEye(camera.getEye() +
 				camera.zoomSpeed*camera.getLook());
@@ -309,6 +361,66 @@ void MouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 	currentButton = button;
 }
 
+// Argument Handler
+// @description
+// - Handles command line options FLTK doesn't know about. Returns the number
+//   of arguments consumed, or 0 if the argument isn't ours.
+int argHandler(int argc, char** argv, int &i) {
+	if (strcmp(argv[i], "-view") == 0 && i + 1 < argc) {
+		viewDim = atoi(argv[i + 1]);
+		i += 2;
+		return 2;
+	}
+	if (strcmp(argv[i], "-budget") == 0 && i + 1 < argc) {
+		genBudget = atof(argv[i + 1]);
+		i += 2;
+		return 2;
+	}
+	if (strcmp(argv[i], "-record") == 0 && i + 1 < argc) {
+		recordFile = argv[i + 1];
+		i += 2;
+		return 2;
+	}
+	if (strcmp(argv[i], "-replay") == 0 && i + 1 < argc) {
+		replayName = argv[i + 1];
+		i += 2;
+		return 2;
+	}
+	if (strcmp(argv[i], "-report") == 0 && i + 1 < argc) {
+		reportFile = argv[i + 1];
+		i += 2;
+		return 2;
+	}
+	if (strcmp(argv[i], "-trace") == 0 && i + 1 < argc) {
+		traceFile = argv[i + 1];
+		Trace::enable(true);
+		i += 2;
+		return 2;
+	}
+	if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+		replayFrames = atoi(argv[i + 1]);
+		i += 2;
+		return 2;
+	}
+	return 0;
+}
+
+// Frame Stats Awake Function
+// @param
+// - data: the FrameStats to summarize
+// @description
+// - Runs on the UI thread when the render thread calls Fl::awake, and shows
+//   the frame rate and frame time percentiles.
+void frameStatsAwake(void *data) {
+	FrameSummary s = ((FrameStats *)data)->summarize(glfwGetTime());
+	char text[128];
+	snprintf(text, sizeof(text), "%.0f", s.fps);
+	box->copy_label(text);
+	snprintf(text, sizeof(text), "p50 %.1f ms\np95 %.1f ms\np99 %.1f ms\nmax %.1f ms\ngpu p95 %.1f ms",
+		s.p50, s.p95, s.p99, s.max, s.gpuP95);
+	frameTimesBox->copy_label(text);
+}
+
 void showPanelCallback(Fl_Widget* widget, void* target) {
 	Fl_Window *current = (Fl_Window*)target;
 
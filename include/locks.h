@@ -1,5 +0,0 @@
-#pragma once
-#include<mutex>
-std::mutex copyFinished;
-std::mutex rowThreadFinished;
-std::mutex colThreadFinished;
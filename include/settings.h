@@ -24,4 +24,10 @@ extern double slHeightc;
 
 // multiplier
 extern double maxH;
+
+// octave level of detail: octaves whose wavelength projects to fewer than
+// lodPixels pixels are faded out with distance (0 disables). A screen-space
+// error threshold, so keep it around a pixel
+extern double lodPixels;
+extern double lodPixelsPerRadian;
 #endif
\ No newline at end of file
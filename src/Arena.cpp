@@ -0,0 +1,99 @@
+#include "Arena.h"
+#include <algorithm>
+#include <cstdint>
+
+// Constructor
+// @description
+// - An empty arena; the first allocation brings in its first block.
+Arena::Arena() {
+	top.block = 0;
+	top.used = 0;
+}
+
+// Mark Method
+// @description
+// - Where the arena is up to, for rewinding to later.
+Arena::Mark Arena::mark() const {
+	return top;
+}
+
+// Rewind Method
+// @param
+// - to: a mark taken earlier
+// @description
+// - Gives back everything allocated since the mark was taken.
+void Arena::rewind(Mark to) {
+	top = to;
+}
+
+// Reset Method
+// @description
+// - Gives back everything, keeping the blocks for the next round.
+void Arena::reset() {
+	top.block = 0;
+	top.used = 0;
+}
+
+// Reserve Method
+// @param
+// - bytes: the size of the largest request expected
+// @description
+// - Makes sure some block can take a request of that size, so the first
+//   one doesn't have to go to the heap. Gives nothing back.
+void Arena::reserve(size_t bytes) {
+	for (size_t b = 0; b < blocks.size(); b++) {
+		if (blocks[b].size >= bytes) {
+			return;
+		}
+	}
+	Block b;
+	b.size = std::max((size_t)ARENA_BLOCK, bytes);
+	b.data.reset(new char[b.size]);
+	blocks.push_back(std::move(b));
+}
+
+// Capacity Method
+// @description
+// - Bytes held in blocks, used or not.
+size_t Arena::capacity() const {
+	size_t total = 0;
+	for (size_t b = 0; b < blocks.size(); b++) {
+		total += blocks[b].size;
+	}
+	return total;
+}
+
+// Local Method
+// @description
+// - The calling thread's own arena, for scratch inside jobs. Each job should
+//   give back what it took with a Scope, as the workers never reset theirs.
+Arena &Arena::local() {
+	static thread_local Arena arena;
+	return arena;
+}
+
+// Allocate Method
+// @param
+// - bytes: the size of the request
+// - align: its alignment, a power of two
+// @description
+// - Bumps the current block, moving on to the next block that is big enough
+//   if it doesn't fit, and only adds a block when none is.
+void *Arena::allocate(size_t bytes, size_t align) {
+	for (; top.block < blocks.size(); top.block++, top.used = 0) {
+		Block &b = blocks[top.block];
+		uintptr_t base = (uintptr_t)b.data.get();
+		size_t at = ((base + top.used + align - 1) & ~(uintptr_t)(align - 1)) - base;
+		if (at + bytes <= b.size) {
+			top.used = at + bytes;
+			return b.data.get() + at;
+		}
+	}
+	Block b;
+	b.size = std::max((size_t)ARENA_BLOCK, bytes + align);
+	b.data.reset(new char[b.size]);
+	blocks.push_back(std::move(b));
+	top.block = blocks.size() - 1;
+	top.used = 0;
+	return allocate(bytes, align);
+}
@@ -0,0 +1,195 @@
+#include "CameraPath.h"
+#include "settings.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+using glm::vec3;
+using std::string;
+
+// settings a path can change, by the name used in path files
+static const struct {
+	const char *name;
+	double *value;
+} settings[] = {
+	{ "seaLevel", &seaLevel },
+	{ "height1a", &height1a }, { "height1b", &height1b }, { "height1c", &height1c },
+	{ "height2a", &height2a }, { "height2b", &height2b }, { "height2c", &height2c },
+	{ "height3a", &height3a }, { "height3b", &height3b }, { "height3c", &height3c },
+	{ "heightPow", &heightPow },
+	{ "slHeighta", &slHeighta }, { "slHeightb", &slHeightb }, { "slHeightc", &slHeightc },
+	{ "maxH", &maxH },
+	{ "lodPixels", &lodPixels },
+};
+static const int SETTINGS = sizeof(settings) / sizeof(settings[0]);
+
+// Record Method
+// @param
+// - eye: the camera's eye position
+// - look: the camera's look direction
+// - up: the camera's up direction
+// @description
+// - Appends a frame. Any setting that differs from the previous frame is
+//   recorded as a change on this frame; the first frame records all of
+//   them, so a replay starts from the same settings.
+void CameraPath::record(vec3 eye, vec3 look, vec3 up) {
+	int frame = frames.size();
+	CameraFrame f = { eye, look, up };
+	frames.push_back(f);
+
+	snapshot.resize(SETTINGS, 0.0);
+	for (int s = 0; s < SETTINGS; s++) {
+		if (frame == 0 || *settings[s].value != snapshot[s]) {
+			SettingChange c = { frame, s, *settings[s].value };
+			changes.push_back(c);
+			snapshot[s] = *settings[s].value;
+		}
+	}
+}
+
+// Apply Method
+// @param
+// - frame: the frame being replayed
+// @description
+// - Applies the setting changes made on a frame. Returns true if there were
+//   any, in which case the view area needs a refresh.
+bool CameraPath::apply(int frame) const {
+	bool changed = false;
+	for (size_t i = 0; i < changes.size(); i++) {
+		if (changes[i].frame == frame) {
+			*settings[changes[i].setting].value = changes[i].value;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+// Save Method
+// @param
+// - file: the file to write
+// @description
+// - Writes the path in the text format described in CameraPath.h.
+bool CameraPath::save(const string &file) const {
+	FILE *f = fopen(file.c_str(), "w");
+	if (!f) {
+		return false;
+	}
+	size_t c = 0;
+	for (size_t i = 0; i < frames.size(); i++) {
+		const CameraFrame &fr = frames[i];
+		fprintf(f, "frame %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n",
+			fr.eye.x, fr.eye.y, fr.eye.z, fr.look.x, fr.look.y, fr.look.z, fr.up.x, fr.up.y, fr.up.z);
+		for (; c < changes.size() && changes[c].frame == (int)i; c++) {
+			fprintf(f, "set %s %.17g\n", settings[changes[c].setting].name, changes[c].value);
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+// Load Method
+// @param
+// - file: the file to read
+// @description
+// - Reads a path written by save. Returns false if the file can't be opened
+//   or has no frames; unknown settings are skipped.
+bool CameraPath::load(const string &file) {
+	std::ifstream in(file.c_str());
+	string line;
+	frames.clear();
+	changes.clear();
+	while (std::getline(in, line)) {
+		std::istringstream ss(line);
+		string kind;
+		ss >> kind;
+		if (kind == "frame") {
+			CameraFrame f;
+			ss >> f.eye.x >> f.eye.y >> f.eye.z >> f.look.x >> f.look.y >> f.look.z >> f.up.x >> f.up.y >> f.up.z;
+			frames.push_back(f);
+		}
+		else if (kind == "set" && frames.size()) {
+			string name;
+			double value;
+			ss >> name >> value;
+			for (int s = 0; s < SETTINGS; s++) {
+				if (name == settings[s].name) {
+					SettingChange c = { (int)frames.size() - 1, s, value };
+					changes.push_back(c);
+				}
+			}
+		}
+	}
+	return frames.size() > 0;
+}
+
+// Canned Method
+// @param
+// - name: straight, zigzag, teleport or hover
+// - count: the number of frames
+// - out: receives the path
+// @description
+// - Built-in paths, moving one sector spacing per frame like the keyboard
+//   controls do:
+//   straight: flies forward along -z
+//   zigzag: flies forward while strafing left and right every 32 frames
+//   teleport: flies forward, jumping far away every 120 frames
+//   hover: stays put while cycling slider changes every 30 frames, covering
+//   post-processing (heightPow, maxH, slHeighta) and frequency (height2b)
+//   changes; those sliders start from their defaults
+//   Returns false for an unknown name.
+bool CameraPath::canned(const string &name, int count, CameraPath &out) {
+	const float step = 0.5f; // Sector().size * 2.0, one cell of the view area
+	const vec3 look = vec3(0.0f, 0.0f, -1.0f);
+	const vec3 up = vec3(0.0f, 1.0f, 0.0f);
+	vec3 eye = vec3(0.0f, 15.0f, 3.0f);
+
+	out = CameraPath();
+	for (int i = 0; i < count; i++) {
+		if (name == "straight") {
+			eye.z -= step;
+		}
+		else if (name == "zigzag") {
+			eye.z -= step;
+			eye.x += (i / 32) % 2 ? -step : step;
+		}
+		else if (name == "teleport") {
+			eye.z -= step;
+			if (i && i % 120 == 0) {
+				eye.x += 4096.0f * step;
+			}
+		}
+		else if (name != "hover") {
+			return false;
+		}
+		CameraFrame f = { eye, look, up };
+		out.frames.push_back(f);
+	}
+
+	if (name == "hover") {
+		// alternate between a changed value and the default for each slider
+		const struct { const char *name; double changed, base; } cycle[] = {
+			{ "heightPow", 2.0, 2.33334 },
+			{ "maxH", 25.0, 20.001 },
+			{ "height2b", 24.0, 20.0 },
+			{ "slHeighta", 0.3, 0.25 },
+		};
+		for (int c = 0; c < 4; c++) {
+			for (int s = 0; s < SETTINGS; s++) {
+				if (strcmp(settings[s].name, cycle[c].name) == 0) {
+					SettingChange change = { 0, s, cycle[c].base };
+					out.changes.push_back(change);
+				}
+			}
+		}
+		for (int i = 30, k = 0; i < count; i += 30, k++) {
+			int c = k % 4;
+			for (int s = 0; s < SETTINGS; s++) {
+				if (strcmp(settings[s].name, cycle[c].name) == 0) {
+					SettingChange change = { i, s, (k / 4) % 2 ? cycle[c].base : cycle[c].changed };
+					out.changes.push_back(change);
+				}
+			}
+		}
+	}
+	return true;
+}
@@ -0,0 +1,88 @@
+#include "ClimateLayer.h"
+#include "Arena.h"
+#include <math.h>
+#include <algorithm>
+
+// Constructor
+// @param
+// - stride: the world distance between lattice points
+// - field: function evaluating the full-resolution field at a world x, z
+// @description
+// - Creates a climate layer. The field is only ever called at lattice points.
+ClimateLayer::ClimateLayer(float stride, Field field) :
+	stride(stride),
+	field(field)
+{
+}
+
+// Sample Method
+// @param
+// - x: world x position
+// - z: world z position
+// @description
+// - Returns the upsampled field value at a single world position.
+float ClimateLayer::sample(float x, float z) const {
+	float out;
+	sampleGrid(&x, 1, &z, 1, &out);
+	return out;
+}
+
+// Sample Grid Method
+// @param
+// - xs: world x position of each column
+// - cols: number of columns
+// - zs: world z position of each row
+// - rows: number of rows
+// - out: receives rows * cols values, row-major
+// @description
+// - Evaluates the field on the lattice points covering the grid once, then
+//   bilinearly interpolates every grid position from them. A row or a column
+//   of sectors only costs a couple of lattice rows of noise.
+void ClimateLayer::sampleGrid(const float *xs, int cols, const float *zs, int rows, float *out) const {
+	if (cols <= 0 || rows <= 0) {
+		return;
+	}
+
+	// find the lattice points covering the grid
+	int a0 = (int)floorf(*std::min_element(xs, xs + cols) / stride);
+	int a1 = (int)floorf(*std::max_element(xs, xs + cols) / stride) + 1;
+	int b0 = (int)floorf(*std::min_element(zs, zs + rows) / stride);
+	int b1 = (int)floorf(*std::max_element(zs, zs + rows) / stride) + 1;
+	int na = a1 - a0 + 1;
+	int nb = b1 - b0 + 1;
+
+	// evaluate the field on the lattice
+	Arena &scratch = Arena::local();
+	Arena::Scope scope(scratch);
+	float *lattice = scratch.alloc<float>(na * nb);
+	for (int b = 0; b < nb; b++) {
+		for (int a = 0; a < na; a++) {
+			lattice[b * na + a] = field((a0 + a) * stride, (b0 + b) * stride);
+		}
+	}
+
+	// work out each column's lattice cell and weight once
+	int *ca = scratch.alloc<int>(cols);
+	float *ta = scratch.alloc<float>(cols);
+	for (int c = 0; c < cols; c++) {
+		float fa = xs[c] / stride;
+		float a = floorf(fa);
+		ca[c] = (int)a - a0;
+		ta[c] = fa - a;
+	}
+
+	// bilinear upsample
+	for (int r = 0; r < rows; r++) {
+		float fb = zs[r] / stride;
+		float b = floorf(fb);
+		float tb = fb - b;
+		const float *l0 = &lattice[((int)b - b0) * na];
+		const float *l1 = l0 + na;
+		for (int c = 0; c < cols; c++) {
+			int a = ca[c];
+			float top = l0[a] + (l0[a + 1] - l0[a]) * ta[c];
+			float bottom = l1[a] + (l1[a + 1] - l1[a]) * ta[c];
+			out[r * cols + c] = top + (bottom - top) * tb;
+		}
+	}
+}
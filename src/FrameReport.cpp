@@ -0,0 +1,80 @@
+#include "FrameReport.h"
+#include <algorithm>
+
+// Percentile Function
+// @param
+// - sorted: the samples, in ascending order
+// - p: the percentile, 0 to 100
+// @description
+// - Nearest-rank percentile; 0 for an empty set.
+double percentile(const std::vector<double> &sorted, double p) {
+	if (!sorted.size()) {
+		return 0.0;
+	}
+	size_t i = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+	return sorted[std::min(i, sorted.size() - 1)];
+}
+
+// Add Method
+// @param
+// - t: the stage times of one frame
+void FrameReport::add(const FrameTimes &t) {
+	frames.push_back(t);
+}
+
+// Last Allocating Method
+// @description
+// - The last frame that made a heap allocation, -1 if none did or nothing
+//   counted them. Frames after it are the allocation-free steady state.
+int FrameReport::lastAllocating() const {
+	for (size_t i = frames.size(); i-- > 0;) {
+		if (frames[i].allocations > 0) {
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+// Write Method
+// @param
+// - f: where to write the report
+// - path: name of the camera path that was run
+// - dim: the view size it was run at
+// @description
+// - Writes one JSON object with the mean, percentiles and maximum of every
+//   stage, of the CPU total and of the GPU passes, in milliseconds. The GPU
+//   passes only count the frames a time came back on. Where allocations
+//   were counted it also gives their total, how many frames made any, and
+//   the last frame that did.
+void FrameReport::write(FILE *f, const std::string &path, int dim) const {
+	const char *names[] = { "generate", "mesh", "upload", "total", "gpu_upload", "gpu_terrain", "gpu_water" };
+	fprintf(f, "{\"path\": \"%s\", \"dim\": %d, \"frames\": %zu", path.c_str(), dim, frames.size());
+	for (int s = 0; s < 7; s++) {
+		std::vector<double> v;
+		double sum = 0.0;
+		for (size_t i = 0; i < frames.size(); i++) {
+			const FrameTimes &t = frames[i];
+			double stage[] = { t.generate, t.mesh, t.upload, t.generate + t.mesh + t.upload,
+				t.gpuUpload, t.gpuTerrain, t.gpuWater };
+			if (stage[s] >= 0.0) {
+				v.push_back(stage[s]);
+				sum += stage[s];
+			}
+		}
+		std::sort(v.begin(), v.end());
+		fprintf(f, ", \"%s_ms\": {\"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f}",
+			names[s], v.size() ? sum / v.size() : 0.0, percentile(v, 50.0), percentile(v, 90.0),
+			percentile(v, 99.0), v.size() ? v.back() : 0.0);
+	}
+	if (frames.size() && frames[0].allocations >= 0) {
+		long long total = 0;
+		int allocating = 0;
+		for (size_t i = 0; i < frames.size(); i++) {
+			total += frames[i].allocations;
+			allocating += frames[i].allocations > 0;
+		}
+		fprintf(f, ", \"allocations\": {\"total\": %lld, \"frames\": %d, \"last_frame\": %d}",
+			total, allocating, lastAllocating());
+	}
+	fprintf(f, "}");
+}
@@ -0,0 +1,107 @@
+#include "FrameStats.h"
+#include <algorithm>
+
+// Percentiles Function
+// @param
+// - window: the samples
+// - p50, p95, p99, max: receive the percentiles of the samples
+static void percentiles(std::vector<float> window, float &p50, float &p95, float &p99, float &max) {
+	if (window.size()) {
+		std::sort(window.begin(), window.end());
+		size_t last = window.size() - 1;
+		p50 = window[(size_t)(last * 0.50 + 0.5)];
+		p95 = window[(size_t)(last * 0.95 + 0.5)];
+		p99 = window[(size_t)(last * 0.99 + 0.5)];
+		max = window[last];
+	}
+}
+
+// Constructor
+// @param
+// - cadence: seconds between summaries
+FrameStats::FrameStats(double cadence) :
+	head(0),
+	lastPush(0.0),
+	tail(0),
+	windowNext(0),
+	gpuNext(0),
+	frames(0),
+	lastSummary(0.0),
+	cadence(cadence)
+{
+}
+
+// Frame Method
+// @param
+// - ms: how long the frame took
+// - gpuMs: a GPU time that came back this frame (see GpuTimer), which lags
+//   behind; negative if none did, as most frames the result isn't ready
+// @description
+// - Render thread side. Queues a frame time without locking; if the reader
+//   has fallen a whole queue behind the frame is dropped.
+void FrameStats::frame(float ms, float gpuMs) {
+	unsigned int h = head.load(std::memory_order_relaxed);
+	if (h - tail.load(std::memory_order_acquire) < STATS_QUEUE) {
+		queue[h % STATS_QUEUE] = ms;
+		gpuQueue[h % STATS_QUEUE] = gpuMs;
+		head.store(h + 1, std::memory_order_release);
+	}
+}
+
+// Due Method
+// @param
+// - now: the current time in seconds
+// @description
+// - Render thread side. Returns true once per cadence, when the reader should
+//   be woken up to summarize.
+bool FrameStats::due(double now) {
+	if (now - lastPush < cadence) {
+		return false;
+	}
+	lastPush = now;
+	return true;
+}
+
+// Summarize Method
+// @param
+// - now: the current time in seconds
+// @description
+// - Reader side. Moves the queued frame times into the rolling window and
+//   returns the frame rate since the last summary along with the percentiles
+//   of the window.
+FrameSummary FrameStats::summarize(double now) {
+	unsigned int h = head.load(std::memory_order_acquire);
+	unsigned int t = tail.load(std::memory_order_relaxed);
+	for (; t != h; t++) {
+		if (window.size() < STATS_WINDOW) {
+			window.push_back(queue[t % STATS_QUEUE]);
+		}
+		else {
+			window[windowNext] = queue[t % STATS_QUEUE];
+			windowNext = (windowNext + 1) % STATS_WINDOW;
+		}
+		float gpu = gpuQueue[t % STATS_QUEUE];
+		if (gpu >= 0.0f) { // only frames a GPU time came back on
+			if (gpuWindow.size() < STATS_WINDOW) {
+				gpuWindow.push_back(gpu);
+			}
+			else {
+				gpuWindow[gpuNext] = gpu;
+				gpuNext = (gpuNext + 1) % STATS_WINDOW;
+			}
+		}
+		frames++;
+	}
+	tail.store(t, std::memory_order_release);
+
+	FrameSummary s;
+	if (lastSummary > 0.0 && now > lastSummary) {
+		s.fps = frames / (now - lastSummary);
+	}
+	frames = 0;
+	lastSummary = now;
+
+	percentiles(window, s.p50, s.p95, s.p99, s.max);
+	percentiles(gpuWindow, s.gpuP50, s.gpuP95, s.gpuP99, s.gpuMax);
+	return s;
+}
@@ -0,0 +1,86 @@
+#include "GpuTimer.h"
+
+// Constructor
+// @param
+// - scopes: the number of scopes timed each frame
+GpuTimer::GpuTimer(int scopes) :
+	scopes(scopes),
+	slot(0),
+	queries(GPU_TIMER_LATENCY * scopes),
+	issued(GPU_TIMER_LATENCY * scopes, false),
+	results(scopes, 0.0f),
+	fresh(false)
+{
+	glGenQueries(queries.size(), &queries[0]);
+}
+
+// Destructor
+GpuTimer::~GpuTimer() {
+	glDeleteQueries(queries.size(), &queries[0]);
+}
+
+// Begin Frame Method
+// @description
+// - Moves on to the next set of queries, first collecting the results they
+//   held from GPU_TIMER_LATENCY frames ago. A set only counts if every scope
+//   timed that frame is ready, so one read never mixes frames; a set that
+//   isn't ready yet is dropped instead of waited on. Scopes that weren't
+//   timed that frame read 0.
+void GpuTimer::beginFrame() {
+	slot = (slot + 1) % GPU_TIMER_LATENCY;
+	bool timed = false, ready = true;
+	for (int s = 0; s < scopes; s++) {
+		int q = slot * scopes + s;
+		if (issued[q]) {
+			GLint available = 0;
+			glGetQueryObjectiv(queries[q], GL_QUERY_RESULT_AVAILABLE, &available);
+			timed = true;
+			ready = ready && available;
+		}
+	}
+	for (int s = 0; s < scopes; s++) {
+		int q = slot * scopes + s;
+		if (timed && ready) {
+			GLuint64 ns = 0;
+			if (issued[q]) {
+				glGetQueryObjectui64v(queries[q], GL_QUERY_RESULT, &ns);
+			}
+			results[s] = ns / 1.0e6f;
+		}
+		issued[q] = false;
+	}
+	fresh = fresh || (timed && ready);
+}
+
+// Begin Method
+// @param
+// - scope: the scope about to be timed
+void GpuTimer::begin(int scope) {
+	int q = slot * scopes + scope;
+	glBeginQuery(GL_TIME_ELAPSED, queries[q]);
+	issued[q] = true;
+}
+
+// End Method
+// @description
+// - Ends the scope started by the last begin.
+void GpuTimer::end() {
+	glEndQuery(GL_TIME_ELAPSED);
+}
+
+// Read Method
+// @param
+// - ms: receives the latest time of each scope in milliseconds
+// @description
+// - Returns false (and leaves ms alone) if nothing new came back since the
+//   last read.
+bool GpuTimer::read(float *ms) {
+	if (!fresh) {
+		return false;
+	}
+	for (int s = 0; s < scopes; s++) {
+		ms[s] = results[s];
+	}
+	fresh = false;
+	return true;
+}
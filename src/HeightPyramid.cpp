@@ -0,0 +1,493 @@
+#include "HeightPyramid.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+using std::vector;
+using glm::vec2;
+using glm::vec3;
+
+static const float INF = std::numeric_limits<float>::infinity();
+static const HeightBounds EMPTY_BOUNDS = { INF, -INF };
+
+// Floor Shift Function
+// @description
+// - g >> level rounded towards negative infinity, for grid coordinates left
+//   of or behind the world origin.
+static int floorShift(int g, int level) {
+	return g >= 0 ? g >> level : -((-g - 1) >> level) - 1;
+}
+
+// Merge Function
+// @description
+// - Widens a to cover b.
+static void merge(HeightBounds &a, const HeightBounds &b) {
+	a.lo = std::min(a.lo, b.lo);
+	a.hi = std::max(a.hi, b.hi);
+}
+
+// Intersect Triangle Function
+// @param
+// - o, d: the ray
+// - a, b, c: the triangle's corners
+// - t: receives the distance along d to the hit
+// @description
+// - Moller-Trumbore ray/triangle test, both faces count.
+static bool intersectTriangle(vec3 o, vec3 d, vec3 a, vec3 b, vec3 c, float &t) {
+	vec3 e1 = b - a;
+	vec3 e2 = c - a;
+	vec3 p = glm::cross(d, e2);
+	float det = glm::dot(e1, p);
+	if (fabsf(det) < 1e-12f) {
+		return false;
+	}
+	float inv = 1.0f / det;
+	vec3 s = o - a;
+	float u = glm::dot(s, p) * inv;
+	if (u < 0.0f || u > 1.0f) {
+		return false;
+	}
+	vec3 q = glm::cross(s, e1);
+	float v = glm::dot(d, q) * inv;
+	if (v < 0.0f || u + v > 1.0f) {
+		return false;
+	}
+	t = glm::dot(e2, q) * inv;
+	return true;
+}
+
+// Constructor
+// @description
+// - An empty pyramid; resize before use.
+HeightPyramid::HeightPyramid() :
+	dim(0),
+	side(1),
+	top(0),
+	spacing(1.0f),
+	originX(0),
+	originZ(0),
+	offset(0.0f),
+	stale(true)
+{
+	levels.push_back(vector<HeightBounds>(1, EMPTY_BOUNDS));
+	queued.push_back(vector<char>(1, 0));
+}
+
+// Resize Method
+// @param
+// - dim: sectors along each side of the view area
+// - spacing: world distance between sectors
+// @description
+// - Sizes the pyramid for a view area. Everything is empty until the next
+//   reset and flush.
+void HeightPyramid::resize(int dim, float spacing) {
+	this->dim = dim;
+	this->spacing = spacing;
+	side = 1;
+	top = 0;
+	while (side < dim) {
+		side <<= 1;
+		top++;
+	}
+	heights.assign(side * side, 0.0f);
+	touched.assign(side * side, 0);
+	levels.resize(top + 1);
+	queued.resize(top + 1);
+	for (int level = 0; level <= top; level++) {
+		int w = side >> level;
+		levels[level].assign(w * w, EMPTY_BOUNDS);
+		queued[level].assign(w * w, 0);
+	}
+	pending.clear();
+	stale = true;
+}
+
+// Reset Method
+// @param
+// - gx, gz: grid coordinates of the view area's first sector
+// - offset: world position of grid coordinate 0, 0
+// @description
+// - Places the view area without keeping anything; every sector has to be set
+//   again before the next flush, which rebuilds the whole pyramid.
+void HeightPyramid::reset(int gx, int gz, vec2 offset) {
+	originX = gx;
+	originZ = gz;
+	this->offset = offset;
+	unqueue();
+	stale = true;
+}
+
+// Move To Method
+// @param
+// - gx, gz: grid coordinates of the view area's first sector
+// - offset: world position of grid coordinate 0, 0
+// @description
+// - Shifts the view area. The columns and rows of cells that left or entered
+//   the view are queued; the caller sets the sectors that entered. Moves too
+//   far to overlap fall back to reset.
+void HeightPyramid::moveTo(int gx, int gz, vec2 offset) {
+	const int cells = dim - 1;
+	if (abs(gx - originX) >= cells || abs(gz - originZ) >= cells) {
+		reset(gx, gz, offset);
+		return;
+	}
+	this->offset = offset;
+
+	// cells between the old and new edges changed from in view to out or back;
+	// queueing the sector at a cell's first corner queues the cell
+	const int x0 = std::min(originX, gx), x1 = std::max(originX, gx) + cells;
+	const int z0 = std::min(originZ, gz), z1 = std::max(originZ, gz) + cells;
+	for (int x = x0; x < std::max(originX, gx); x++) {
+		for (int z = z0; z < z1; z++) {
+			touch(x, z);
+			touch(x + cells, z);
+		}
+	}
+	for (int z = z0; z < std::max(originZ, gz); z++) {
+		for (int x = x0; x < x1; x++) {
+			touch(x, z);
+			touch(x, z + cells);
+		}
+	}
+	originX = gx;
+	originZ = gz;
+}
+
+// Set Method
+// @param
+// - gx, gz: grid coordinates of the sector
+// - height: the sector's height
+// @description
+// - Queues the sector if its height changed. A sector that just came into
+//   view needs no check: its cells were queued by moveTo.
+void HeightPyramid::set(int gx, int gz, float height) {
+	float &h = heights[wrap(gz) * side + wrap(gx)];
+	if (h != height) {
+		h = height;
+		touch(gx, gz);
+	}
+}
+
+// Flush Method
+// @description
+// - Recomputes the cells around the queued sectors and then their parents a
+//   level at a time. Each node is queued once however many of its children
+//   changed, so changes from several moves cost no more than one when they
+//   overlap; callers only need to flush before they query.
+void HeightPyramid::flush() {
+	if (stale) {
+		rebuild();
+		return;
+	}
+	vector<int> cells, current, parents;
+	for (size_t k = 0; k < pending.size(); k++) {
+		int x = pending[k] & (side - 1);
+		int z = pending[k] >> top;
+		touched[pending[k]] = 0;
+		for (int c = 0; c < 4; c++) {
+			int idx = wrap(z - (c >> 1)) * side + wrap(x - (c & 1));
+			if (!queued[0][idx]) {
+				queued[0][idx] = 1;
+				cells.push_back(idx);
+			}
+		}
+	}
+	for (size_t k = 0; k < cells.size(); k++) {
+		queued[0][cells[k]] = 0;
+		levels[0][cells[k]] = leaf(cells[k]);
+	}
+	const vector<int> *children = &cells;
+	for (int level = 1; level <= top && !children->empty(); level++) {
+		const int shift = top - level; // log2 of the width at this level
+		const int w = 1 << shift;
+		const vector<HeightBounds> &below = levels[level - 1];
+		vector<char> &mark = queued[level];
+		parents.clear();
+		for (size_t k = 0; k < children->size(); k++) {
+			int x = (*children)[k] & (2 * w - 1);
+			int z = (*children)[k] >> (shift + 1);
+			int parent = ((z >> 1) << shift) + (x >> 1);
+			if (!mark[parent]) {
+				mark[parent] = 1;
+				parents.push_back(parent);
+			}
+		}
+		for (size_t k = 0; k < parents.size(); k++) {
+			mark[parents[k]] = 0;
+			int child = ((parents[k] >> shift) << (shift + 2)) + ((parents[k] & (w - 1)) << 1);
+			HeightBounds b = below[child];
+			merge(b, below[child + 1]);
+			merge(b, below[child + 2 * w]);
+			merge(b, below[child + 2 * w + 1]);
+			levels[level][parents[k]] = b;
+		}
+		current.swap(parents);
+		children = &current;
+	}
+	pending.clear();
+}
+
+// Rebuild Method
+// @description
+// - Recomputes every node from the heights.
+void HeightPyramid::rebuild() {
+	for (int idx = 0; idx < side * side; idx++) {
+		levels[0][idx] = leaf(idx);
+	}
+	for (int level = 1; level <= top; level++) {
+		const int w = side >> level;
+		const vector<HeightBounds> &below = levels[level - 1];
+		for (int z = 0; z < w; z++) {
+			for (int x = 0; x < w; x++) {
+				int child = z * 4 * w + x * 2;
+				HeightBounds b = below[child];
+				merge(b, below[child + 1]);
+				merge(b, below[child + 2 * w]);
+				merge(b, below[child + 2 * w + 1]);
+				levels[level][z * w + x] = b;
+			}
+		}
+	}
+	unqueue();
+	stale = false;
+}
+
+// Bounds Method
+// @param
+// - gx0, gz0: grid coordinates of the first cell
+// - gx1, gz1: grid coordinates one past the last cell
+// @description
+// - Height bounds of the cells in the range that are in view. The range is
+//   split into the largest aligned blocks that fit inside it, so this visits
+//   a few nodes per level along its edges instead of every cell.
+HeightBounds HeightPyramid::bounds(int gx0, int gz0, int gx1, int gz1) const {
+	HeightBounds out = EMPTY_BOUNDS;
+	gx0 = std::max(gx0, originX);
+	gz0 = std::max(gz0, originZ);
+	gx1 = std::min(gx1, originX + dim - 1);
+	gz1 = std::min(gz1, originZ + dim - 1);
+	if (gx0 >= gx1 || gz0 >= gz1) {
+		return out;
+	}
+	// the view is narrower than a root block, so it touches at most two each way
+	for (int bz = floorShift(gz0, top); bz * side < gz1; bz++) {
+		for (int bx = floorShift(gx0, top); bx * side < gx1; bx++) {
+			query(top, bx, bz, gx0, gz0, gx1, gz1, out);
+		}
+	}
+	return out;
+}
+
+// Query Method
+// @param
+// - level, bx, bz: the block to look in
+// - gx0, gz0, gx1, gz1: the cell range, already clipped to the view
+// - out: widened to cover the cells of the block inside the range
+// @description
+// - A block entirely inside the range is taken whole from its node, which
+//   only holds cells in view since the view is narrower than the wrap.
+void HeightPyramid::query(int level, int bx, int bz, int gx0, int gz0, int gx1, int gz1, HeightBounds &out) const {
+	const int size = 1 << level;
+	int x0 = bx * size;
+	int z0 = bz * size;
+	if (x0 >= gx1 || z0 >= gz1 || x0 + size <= gx0 || z0 + size <= gz0) {
+		return;
+	}
+	if (x0 >= gx0 && z0 >= gz0 && x0 + size <= gx1 && z0 + size <= gz1) {
+		merge(out, levels[level][node(level, bx, bz)]);
+		return;
+	}
+	for (int k = 0; k < 4; k++) {
+		query(level - 1, bx * 2 + (k & 1), bz * 2 + (k >> 1), gx0, gz0, gx1, gz1, out);
+	}
+}
+
+// Region Bounds Method
+// @param
+// - lo: the world x, z corner of the region with the smallest coordinates
+// - hi: the opposite corner
+// @description
+// - Height bounds of the terrain over a world rectangle, counting every cell
+//   the rectangle touches.
+HeightBounds HeightPyramid::regionBounds(vec2 lo, vec2 hi) const {
+	vec2 g0 = (lo - offset) / spacing;
+	vec2 g1 = (hi - offset) / spacing;
+	return bounds((int)floorf(g0.x), (int)floorf(g0.y), (int)floorf(g1.x) + 1, (int)floorf(g1.y) + 1);
+}
+
+// Raycast Method
+// @param
+// - origin: the world position the ray starts at
+// - dir: the ray's direction
+// - maxDist: how far along the ray to look, in multiples of dir
+// - t: receives the distance to the first hit, in multiples of dir
+// @description
+// - Finds where the ray first meets the terrain, drawn as the same two
+//   triangles per cell as the mesh. The ray walks the pyramid front to back:
+//   a block it passes entirely above or below is stepped over in one go,
+//   otherwise it drops a level, and after each step it climbs a level again
+//   so open ground is crossed in big strides. Only the cells the ray actually
+//   dips into get triangle tests.
+bool HeightPyramid::raycast(vec3 origin, vec3 dir, float maxDist, float &t) const {
+	const HeightBounds &root = levels[top][0];
+	if (stale || root.empty()) {
+		return false;
+	}
+	// grid units across, world units up; the ray parameter is unchanged
+	vec3 o((origin.x - offset.x) / spacing, origin.y, (origin.z - offset.y) / spacing);
+	vec3 d(dir.x / spacing, dir.y, dir.z / spacing);
+
+	// clip to the box around the view area's terrain
+	vec3 boxLo((float)originX, root.lo, (float)originZ);
+	vec3 boxHi((float)(originX + dim - 1), root.hi, (float)(originZ + dim - 1));
+	float t0 = 0.0f, t1 = maxDist;
+	for (int k = 0; k < 3; k++) {
+		if (d[k] == 0.0f) {
+			if (o[k] < boxLo[k] || o[k] > boxHi[k]) {
+				return false;
+			}
+			continue;
+		}
+		float a = (boxLo[k] - o[k]) / d[k];
+		float b = (boxHi[k] - o[k]) / d[k];
+		t0 = std::max(t0, std::min(a, b));
+		t1 = std::min(t1, std::max(a, b));
+	}
+	if (t0 > t1) {
+		return false;
+	}
+
+	int cx = glm::clamp((int)floorf(o.x + d.x * t0), originX, originX + dim - 2);
+	int cz = glm::clamp((int)floorf(o.z + d.z * t0), originZ, originZ + dim - 2);
+	int level = top;
+	while (true) {
+		const int size = 1 << level;
+		int bx = floorShift(cx, level);
+		int bz = floorShift(cz, level);
+
+		// where the ray leaves this block
+		float tx = d.x > 0.0f ? ((bx + 1) * size - o.x) / d.x : d.x < 0.0f ? (bx * size - o.x) / d.x : INF;
+		float tz = d.z > 0.0f ? ((bz + 1) * size - o.z) / d.z : d.z < 0.0f ? (bz * size - o.z) / d.z : INF;
+		float tb = glm::clamp(std::min(tx, tz), t0, t1);
+
+		const HeightBounds &b = levels[level][node(level, bx, bz)];
+		float y0 = o.y + d.y * t0;
+		float y1 = o.y + d.y * tb;
+		if (!b.empty() && std::min(y0, y1) <= b.hi && std::max(y0, y1) >= b.lo) {
+			if (level > 0) {
+				level--;
+				continue;
+			}
+			if (hitCell(cx, cz, origin, dir, t1, t)) {
+				return true;
+			}
+		}
+		if (tb >= t1) {
+			return false;
+		}
+
+		// step into the neighbouring block and climb back up
+		if (tx <= tz) {
+			cx = d.x > 0.0f ? (bx + 1) * size : bx * size - 1;
+			cz = glm::clamp((int)floorf(o.z + d.z * tb), bz * size, (bz + 1) * size - 1);
+		} else {
+			cz = d.z > 0.0f ? (bz + 1) * size : bz * size - 1;
+			cx = glm::clamp((int)floorf(o.x + d.x * tb), bx * size, (bx + 1) * size - 1);
+		}
+		if (!inView(cx, cz)) {
+			return false;
+		}
+		t0 = tb;
+		level = std::min(level + 1, top);
+	}
+}
+
+// Node Method
+// @description
+// - Index of a block's node at a level, from the block's unwrapped coordinates.
+int HeightPyramid::node(int level, int bx, int bz) const {
+	const int w = side >> level;
+	return (bz & (w - 1)) * w + (bx & (w - 1));
+}
+
+// In View Method
+// @description
+// - Whether a cell lies between four sectors of the view area.
+bool HeightPyramid::inView(int gx, int gz) const {
+	return gx >= originX && gx < originX + dim - 1 && gz >= originZ && gz < originZ + dim - 1;
+}
+
+// Touch Method
+// @description
+// - Queues a sector, and so the four cells around it, for the next flush.
+void HeightPyramid::touch(int gx, int gz) {
+	int idx = wrap(gz) * side + wrap(gx);
+	if (!stale && !touched[idx]) {
+		touched[idx] = 1;
+		pending.push_back(idx);
+	}
+}
+
+// Unqueue Method
+// @description
+// - Drops the queued sectors without recomputing anything.
+void HeightPyramid::unqueue() {
+	for (size_t k = 0; k < pending.size(); k++) {
+		touched[pending[k]] = 0;
+	}
+	pending.clear();
+}
+
+// Leaf Method
+// @param
+// - idx: a level 0 node
+// @description
+// - Bounds of the cell stored in the node, which is the one in view that
+//   wraps onto it if there is one.
+HeightBounds HeightPyramid::leaf(int idx) const {
+	int x = idx & (side - 1);
+	int z = idx >> top;
+	if (wrap(x - originX) >= dim - 1 || wrap(z - originZ) >= dim - 1) {
+		return EMPTY_BOUNDS;
+	}
+	int x1 = wrap(x + 1);
+	int z1 = wrap(z + 1);
+	float h[] = { heights[z * side + x], heights[z * side + x1], heights[z1 * side + x], heights[z1 * side + x1] };
+	HeightBounds b = { h[0], h[0] };
+	for (int k = 1; k < 4; k++) {
+		b.lo = std::min(b.lo, h[k]);
+		b.hi = std::max(b.hi, h[k]);
+	}
+	return b;
+}
+
+// Hit Cell Method
+// @param
+// - gx, gz: grid coordinates of the cell
+// - origin, dir: the ray, in world space
+// - maxT: the furthest hit to accept
+// - t: receives the distance to the nearer hit
+// @description
+// - Tests the cell's two triangles, split the same way as the mesh.
+bool HeightPyramid::hitCell(int gx, int gz, vec3 origin, vec3 dir, float maxT, float &t) const {
+	int x1 = wrap(gx + 1);
+	int z1 = wrap(gz + 1);
+	float x = offset.x + gx * spacing;
+	float z = offset.y + gz * spacing;
+	vec3 a(x, heights[wrap(gz) * side + wrap(gx)], z);
+	vec3 b(x + spacing, heights[wrap(gz) * side + x1], z);
+	vec3 c(x, heights[z1 * side + wrap(gx)], z + spacing);
+	vec3 e(x + spacing, heights[z1 * side + x1], z + spacing);
+	float best = INF, hit;
+	if (intersectTriangle(origin, dir, a, b, c, hit) && hit >= 0.0f && hit < best) {
+		best = hit;
+	}
+	if (intersectTriangle(origin, dir, e, c, b, hit) && hit >= 0.0f && hit < best) {
+		best = hit;
+	}
+	if (best > maxT) {
+		return false;
+	}
+	t = best;
+	return true;
+}
@@ -0,0 +1,212 @@
+#include "JobSystem.h"
+#include "Trace.h"
+#include "Arena.h"
+#include <algorithm>
+#include <string>
+
+// Constructor
+// @param
+// - workers: the number of worker threads, 0 for one per core less the
+//   calling thread, which helps out while it waits
+JobSystem::JobSystem(int workers) :
+	next(0),
+	queued(0),
+	stopping(false)
+{
+	if (workers <= 0) {
+		workers = std::max((int)std::thread::hardware_concurrency() - 1, 1);
+	}
+	for (int w = 0; w < workers; w++) {
+		queues.push_back(std::unique_ptr<Queue>(new Queue()));
+		queues.back()->jobs.reserve(JOB_QUEUE_RESERVE);
+	}
+	for (int w = 0; w < workers; w++) {
+		threads.push_back(std::thread(&JobSystem::work, this, w));
+	}
+}
+
+// Destructor
+// @description
+// - Stops the workers once their current jobs finish. Jobs still queued are
+//   never run; their owners must have waited for or cancelled them.
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> guard(sleep);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t t = 0; t < threads.size(); t++) {
+		threads[t].join();
+	}
+}
+
+// Submit Method
+// @param
+// - group: the group the job belongs to
+// - priority: how urgent the job is, lower runs first; distance to the
+//   camera for terrain, plus JOB_BACKGROUND for work no frame waits for
+// - task: the work itself
+void JobSystem::submit(JobGroup &group, float priority, Task task) {
+	group.pending++;
+	Queue &q = *queues[next++ % queues.size()];
+	{
+		std::lock_guard<std::mutex> guard(q.lock);
+		std::vector<Job>::iterator at = q.jobs.end();
+		while (at != q.jobs.begin() && (at - 1)->priority <= priority) {
+			--at; // ahead of equally urgent jobs, so those still run first
+		}
+		Job job = { priority, &group, std::move(task) };
+		q.jobs.insert(at, std::move(job));
+	}
+	queued++;
+	std::lock_guard<std::mutex> guard(sleep);
+	wake.notify_one();
+}
+
+// Wait Method
+// @param
+// - group: the group to wait for
+// @description
+// - Returns once every job of the group has finished or been skipped. The
+//   caller runs the group's queued jobs itself, most urgent first, and only
+//   sleeps while the last of them are running on workers.
+void JobSystem::wait(JobGroup &group) {
+	Job job;
+	while (!group.done()) {
+		if (popGroup(group, job)) {
+			run(job);
+			continue;
+		}
+		std::unique_lock<std::mutex> guard(sleep);
+		finished.wait(guard, [&group] { return group.done(); });
+	}
+}
+
+// Workers Method
+// @description
+// - The number of worker threads, not counting threads that wait.
+int JobSystem::workers() const {
+	return (int)threads.size();
+}
+
+// Pop Method
+// @param
+// - home: the worker's own queue
+// - job: receives the job
+// @description
+// - The most urgent job of the worker's own queue, or failing that the most
+//   urgent job of any other queue. Returns false if every queue was empty.
+bool JobSystem::pop(int home, Job &job) {
+	{
+		Queue &q = *queues[home];
+		std::lock_guard<std::mutex> guard(q.lock);
+		if (!q.jobs.empty()) {
+			job = std::move(q.jobs.back());
+			q.jobs.pop_back();
+			queued--;
+			return true;
+		}
+	}
+	while (queued.load() > 0) {
+		int victim = -1;
+		float best = 0.0f;
+		for (int w = 0; w < (int)queues.size(); w++) {
+			Queue &q = *queues[w];
+			std::lock_guard<std::mutex> guard(q.lock);
+			if (!q.jobs.empty() && (victim < 0 || q.jobs.back().priority < best)) {
+				victim = w;
+				best = q.jobs.back().priority;
+			}
+		}
+		if (victim < 0) {
+			return false;
+		}
+		Queue &q = *queues[victim];
+		std::lock_guard<std::mutex> guard(q.lock);
+		if (!q.jobs.empty()) { // may have been taken since the scan, look again if so
+			job = std::move(q.jobs.back());
+			q.jobs.pop_back();
+			queued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Pop Group Method
+// @param
+// - group: the group to take a job of
+// - job: receives the job
+// @description
+// - The most urgent queued job of one group, from any queue.
+bool JobSystem::popGroup(JobGroup &group, Job &job) {
+	int victim = -1;
+	float best = 0.0f;
+	for (int w = 0; w < (int)queues.size(); w++) {
+		Queue &q = *queues[w];
+		std::lock_guard<std::mutex> guard(q.lock);
+		for (size_t k = q.jobs.size(); k-- > 0;) {
+			if (q.jobs[k].group == &group) {
+				if (victim < 0 || q.jobs[k].priority < best) {
+					victim = w;
+					best = q.jobs[k].priority;
+				}
+				break;
+			}
+		}
+	}
+	if (victim < 0) {
+		return false;
+	}
+	Queue &q = *queues[victim];
+	std::lock_guard<std::mutex> guard(q.lock);
+	for (size_t k = q.jobs.size(); k-- > 0;) {
+		if (q.jobs[k].group == &group) {
+			job = std::move(q.jobs[k]);
+			q.jobs.erase(q.jobs.begin() + k);
+			queued--;
+			return true;
+		}
+	}
+	return false; // a worker got there first, the caller looks again
+}
+
+// Run Method
+// @description
+// - Runs a job unless its group was cancelled, then counts it off.
+void JobSystem::run(Job &job) {
+	JobGroup &group = *job.group;
+	if (!group.isCancelled()) {
+		job.task();
+	}
+	job.task.clear(); // let go of anything the task captured before the group is done
+	if (--group.pending == 0) {
+		std::lock_guard<std::mutex> guard(sleep);
+		finished.notify_all();
+	}
+}
+
+// Work Method
+// @param
+// - index: the worker's own queue
+// @description
+// - Worker thread: runs jobs until the system stops, sleeping while every
+//   queue is empty. The worker's scratch arena gets its first block now
+//   rather than whenever its first job happens to need it.
+void JobSystem::work(int index) {
+	std::string name = "job worker " + std::to_string(index);
+	Trace::nameThread(name.c_str());
+	Arena::local().reserve(ARENA_BLOCK);
+	Job job;
+	while (true) {
+		if (pop(index, job)) {
+			run(job);
+			continue;
+		}
+		std::unique_lock<std::mutex> guard(sleep);
+		wake.wait(guard, [this] { return stopping || queued.load() > 0; });
+		if (stopping) {
+			return;
+		}
+	}
+}
@@ -1,5 +1,7 @@
 #include "Occulus.h"
-#include "locks.h"
+#include "Trace.h"
+#include "VertexCache.h"
+#include <algorithm>
 using glm::clamp;
 using std::make_tuple;
 
@@ -7,11 +9,14 @@ using std::make_tuple;
 // @description:
 // - Used to create a new view area centered at X:0.0, Y:0.0, Z:0.0
 Occulus::Occulus() :
-	spacing(Sector().size * 2.0)
+	dim(O_DIM),
+	spacing(Sector().size * 2.0),
+	temperature(C_DIM * spacing, [this](float x, float z) { return temperatureNoise(x, z); }),
+	prefetch(jobs, [this](PrefetchLine &line) { bakeLine(line); })
 {
 	position = vec3(0.0f, 0.0f, 0.0f);
 	lPosition = position;
-	size = spacing * O_DIM * C_DIM;
+	size = spacing * dim;
 	open_simplex_noise(77374, &ctx);
 	initMap();
 }
@@ -26,9 +31,12 @@ Occulus::Occulus() :
 //   view area centered at hte specified location
 Occulus::Occulus(float x, float y, float z) :
 	position(vec3(x, y, z)),
-	spacing(Sector().size * 2.0)
+	dim(O_DIM),
+	spacing(Sector().size * 2.0),
+	temperature(C_DIM * spacing, [this](float x, float z) { return temperatureNoise(x, z); }),
+	prefetch(jobs, [this](PrefetchLine &line) { bakeLine(line); })
 {
-	size = spacing * O_DIM * C_DIM;
+	size = spacing * dim;
 	lPosition = position;
 	open_simplex_noise(77374, &ctx);
 	initMap();
@@ -42,112 +50,944 @@ Occulus::Occulus(float x, float y, float z) :
 //  view area
 Occulus::Occulus(vec3 pos) :
 	position(pos),
-	spacing(Sector().size * 2.0)
+	dim(O_DIM),
+	spacing(Sector().size * 2.0),
+	temperature(C_DIM * spacing, [this](float x, float z) { return temperatureNoise(x, z); }),
+	prefetch(jobs, [this](PrefetchLine &line) { bakeLine(line); })
 {
-	size = spacing * O_DIM;
+	size = spacing * dim;
 	lPosition = position;
 	open_simplex_noise(77374, &ctx);
 	initMap();
 }
 
+// Sized Constructor
+// @param
+// - pos: the position of the center of the view area
+// - viewDim: the number of sectors along each side of the view area
+// - budgetMs: the generation budget per frame, see setBudget; with one the
+//   map streams in over the first frames instead of being built up front
+// @description
+// - Creates a runtime-sized view area. Prefer Occulus::create, which returns
+//   a compile-time specialization when one exists for the requested size.
+Occulus::Occulus(vec3 pos, int viewDim, double budgetMs) :
+	position(pos),
+	dim(viewDim),
+	spacing(Sector().size * 2.0),
+	temperature(C_DIM * spacing, [this](float x, float z) { return temperatureNoise(x, z); }),
+	budget(budgetMs),
+	prefetch(jobs, [this](PrefetchLine &line) { bakeLine(line); })
+{
+	size = spacing * dim;
+	lPosition = position;
+	open_simplex_noise(77374, &ctx);
+	initMap();
+}
+
+// Create Method
+// @param
+// - pos: the position of the center of the view area
+// - viewDim: the requested number of sectors along each side of the view area
+// - budgetMs: the generation budget per frame, 0 for none, see setBudget
+// @description
+// - Factory for view areas. The size is rounded up to a whole number of
+//   chunks; common sizes get a FixedOcculus so the per-frame loops run with
+//   constant dimensions, anything else uses the runtime-sized base class.
+Occulus *Occulus::create(vec3 pos, int viewDim, double budgetMs) {
+	int chunks = glm::max((viewDim + C_DIM - 1) / C_DIM, 1);
+	switch (chunks * C_DIM) {
+	case C_DIM * 10: return new FixedOcculus<C_DIM * 10>(pos, budgetMs);
+	case C_DIM * 20: return new FixedOcculus<C_DIM * 20>(pos, budgetMs);
+	case C_DIM * 30: return new FixedOcculus<C_DIM * 30>(pos, budgetMs);
+	case C_DIM * 40: return new FixedOcculus<C_DIM * 40>(pos, budgetMs);
+	default: return new Occulus(pos, chunks * C_DIM, budgetMs);
+	}
+}
+
+// Octave Parameters
+// @param
+// - amp: receives the amplitude of each octave
+// - fx: receives the x frequency of each octave
+// - fz: receives the z frequency of each octave
+// @description
+// - Gathers the noise settings for the height and sea bed octaves so they can
+//   be processed in a loop.
+static void octaveParams(float amp[OCTAVES], float fx[OCTAVES], float fz[OCTAVES]) {
+	amp[0] = height1a; fx[0] = height1b; fz[0] = height1c;
+	amp[1] = height2a; fx[1] = height2b; fz[1] = height2c;
+	amp[2] = height3a; fx[2] = height3b; fz[2] = height3c;
+	amp[SEA_OCTAVE] = slHeighta; fx[SEA_OCTAVE] = slHeightb; fz[SEA_OCTAVE] = slHeightc;
+}
+
+// Weighted Add
+// @param
+// - out: the values to add to
+// - w: each value's octave weight
+// - f: a factor for every value; negative to subtract
+// - in: the octave's values
+// - count: the number of values
+// @description
+// - out += w * f * in, one output per loop so the compiler only has to rule
+//   out overlap between a few arrays before it will vectorize. Rounds the same
+//   as writing the sum out in place, as f = 1 and negating are both exact.
+static void weightedAdd(float *out, const float *w, float f, const float *in, int count) {
+	for (int idx = 0; idx < count; idx++) {
+		out[idx] += w[idx] * f * in[idx];
+	}
+}
+
 // MapNoise Method
 // @param
-// - index: the sector index to map noise to
+// - sec: the sector to map noise to
+// - out: the octave tiles holding the sector's raw noise
+// - idx: the sector's index in the tiles
+// - lod: the packed weight level of each octave for this sector
 // @description
-// - Uses open simplex to generate noise values for temperature
-//   and height, multiplies these values, and sets them as the height
-//   and temperature for the sector at the passed index.
-tuple<float, float> Occulus::mapNoise(vec3 pos) {
-	vec3 tVec = position + pos;
-	float nx = tVec.x / (O_DIM * 1.0) - 0.5;
+// - Uses open simplex to bake the raw noise for each octave the sector's
+//   level of detail needs, skipping octaves that are already evaluated or
+//   faded out completely. The result still has to be combined, either per
+//   sector with combine or for the whole map with combineMap.
+void Occulus::mapNoise(Sector &sec, OctaveTiles &out, int idx, unsigned int lod) {
+	vec3 tVec = position + sec.position;
+	float nx = tVec.x / (O_DIM * 1.0) - 0.5; // noise scale is fixed so terrain does not depend on view size
 	float nz = tVec.z / (O_DIM * 1.0) - 0.5;
-	float tVal = open_simplex_noise2(ctx, nx, nz);
+	float amp[OCTAVES], fx[OCTAVES], fz[OCTAVES];
+	double ddx, ddz;
+
+	octaveParams(amp, fx, fz);
+	for (int k = 0; k < OCTAVES; k++) {
+		if (lodLevel(lod, k) && !(sec.evaluated & (1 << k))) {
+			float v = open_simplex_noise2_deriv(ctx, nx * fx[k], nz * fz[k], &ddx, &ddz);
+			out.set(k, idx, v, ddx, ddz);
+			sec.evaluated |= 1 << k;
+		}
+	}
+	sec.lod = lod;
+}
+
+// Combine Method
+// @param
+// - sec: the sector to combine noise for
+// - in: the octave tiles holding the sector's raw noise
+// - idx: the sector's index in the tiles
+// @description
+// - Builds the sector's height, temperature and normal from its raw noise.
+//   Each octave is weighted by its level of detail, and its derivative is
+//   carried through the same sum / pow / scale chain as the height so the
+//   normal is exact. Must give the same result as combineMap.
+void Occulus::combine(Sector &sec, const OctaveTiles &in, int idx) {
+	float amp[OCTAVES], fx[OCTAVES], fz[OCTAVES], w[OCTAVES];
+	const float pw = heightPow;
+
+	octaveParams(amp, fx, fz);
+	for (int k = 0; k < OCTAVES; k++) {
+		w[k] = amp[k] * lodLevel(sec.lod, k) / float(LOD_LEVELS);
+	}
+
+	// height octaves, keeping d(hVal)/d(nx) and d(hVal)/d(nz) alongside
+	float hVal = 0.0f;
+	vec2 dh = vec2(0.0f, 0.0f);
+	for (int k = 0; k < SEA_OCTAVE; k++) {
+		hVal += w[k] * in.value[k][idx];
+		dh += vec2(w[k] * fx[k] * in.dx[k][idx], w[k] * fz[k] * in.dz[k][idx]);
+	}
+
+	// raise to our power; flat wherever the power clamps to zero, and powf
+	// only sees heights it can't blow up on when the power is below 1
+	float q = hVal > FLAT_HEIGHT ? powf(hVal, pw - 1.0f) : 0.0f;
+	dh = dh * (pw * q);
+	hVal = hVal * q;
+
+	// sea bed and height multiplier
+	hVal -= w[SEA_OCTAVE] * in.value[SEA_OCTAVE][idx];
+	dh -= vec2(w[SEA_OCTAVE] * fx[SEA_OCTAVE] * in.dx[SEA_OCTAVE][idx],
+		w[SEA_OCTAVE] * fz[SEA_OCTAVE] * in.dz[SEA_OCTAVE][idx]);
+	hVal *= float(maxH);
+	dh = dh * float(maxH / O_DIM); // back to world units (d(nx)/dx = 1 / O_DIM)
+	sec.position.y = hVal;
+	sec.temp = clamp(sec.baseTemp * 100.0 - hVal*2.0, 0.0, 100.0);
+	sec.normal = glm::normalize(vec3(-dh.x, 1.0f, -dh.y));
+}
+
+// Combine Map Method
+// @param
+// - grid: the grid dimensions, either a FixedGrid or a RuntimeGrid
+// - i0: the first row of slots
+// - rows: the number of rows
+// @description
+// - Same as combine but for a band of whole rows at once, as a series of
+//   flat loops over the octave tiles that the compiler can vectorize. This is
+//   all a refresh costs when only post-processing parameters (heightPow, maxH,
+//   the octave amplitudes) changed. Bands don't overlap, so each can be a job.
+template <class Grid>
+void Occulus::combineMap(const Grid &grid, int i0, int rows) {
+	TRACE_ZONE("combineMap");
+	const int first = grid.index(i0, 0);
+	const int count = rows * grid.dim();
+	const float pw = heightPow;
+	const float hMul = maxH;
+	const float gMul = maxH / O_DIM;
+	float amp[OCTAVES], fx[OCTAVES], fz[OCTAVES];
+	Arena &scratch = Arena::local();
+	Arena::Scope scope(scratch);
+	float *w = scratch.alloc<float>(count), *h = scratch.alloc<float>(count);
+	float *gx = scratch.alloc<float>(count), *gz = scratch.alloc<float>(count);
+	float *q = scratch.alloc<float>(count);
+	Sector *sectors = map.data() + first;
+
+	octaveParams(amp, fx, fz);
+	for (int k = 0; k < OCTAVES; k++) {
+		// this octave's weight for each sector
+		for (int idx = 0; idx < count; idx++) {
+			w[idx] = amp[k] * lodLevel(sectors[idx].lod, k) / float(LOD_LEVELS);
+		}
+
+		const float *v = tiles.value[k].data() + first;
+		const float *ddx = tiles.dx[k].data() + first;
+		const float *ddz = tiles.dz[k].data() + first;
+		if (k != SEA_OCTAVE) {
+			weightedAdd(h, w, 1.0f, v, count);
+			weightedAdd(gx, w, fx[k], ddx, count);
+			weightedAdd(gz, w, fz[k], ddz, count);
+			continue;
+		}
 
-	float hVal = height1a * open_simplex_noise2(ctx, nx * height1b, nz * height1c);
-		  hVal += height2a * open_simplex_noise2(ctx, nx * height2b, nz * height2c);
-		  hVal += height3a * open_simplex_noise2(ctx, nx * height3b, nz * height3c);
-		  hVal = glm::max(powf(hVal, heightPow), 0.0f);
-		  hVal -= slHeighta * open_simplex_noise2(ctx, nx * slHeightb, nz * slHeightc);
-		  hVal *= maxH;
-		  tVal = clamp(tVal * 100.0 - hVal*2.0, 0.0, 100.0);
-	return make_tuple(hVal, tVal);
+		// raise to our power before the sea bed goes in, flat at or below
+		// FLAT_HEIGHT. Branch free, with the powf in a loop of its own so the
+		// clamp and scale still vectorize when the compiler has no vector powf
+		// (GCC only uses libmvec's under -ffast-math)
+		for (int idx = 0; idx < count; idx++) {
+			q[idx] = std::max(h[idx], FLAT_HEIGHT);
+		}
+		for (int idx = 0; idx < count; idx++) {
+			q[idx] = powf(q[idx], pw - 1.0f);
+		}
+		for (int idx = 0; idx < count; idx++) {
+			float hVal = h[idx], qVal = q[idx];
+			float scale = hVal > FLAT_HEIGHT ? qVal : 0.0f;
+			h[idx] = hVal * scale;
+			gx[idx] = gx[idx] * (pw * scale);
+			gz[idx] = gz[idx] * (pw * scale);
+		}
+		weightedAdd(h, w, -1.0f, v, count);
+		weightedAdd(gx, w, -fx[k], ddx, count);
+		weightedAdd(gz, w, -fz[k], ddz, count);
+	}
+
+	// height multiplier, then write the results back to the sectors
+	for (int idx = 0; idx < count; idx++) {
+		Sector &sec = sectors[idx];
+		float hVal = h[idx] * hMul;
+		sec.position.y = hVal;
+		sec.temp = clamp(sec.baseTemp * 100.0 - hVal*2.0, 0.0, 100.0);
+		sec.normal = glm::normalize(vec3(-gx[idx] * gMul, 1.0f, -gz[idx] * gMul));
+	}
+}
+
+// Bake Changed Method
+// @description
+// - Checks the octave frequencies against the ones the tiles were baked at and
+//   records the current ones. Returns true if the baked noise is stale.
+bool Occulus::bakeChanged() {
+	float amp[OCTAVES], fx[OCTAVES], fz[OCTAVES];
+	bool changed = false;
+
+	octaveParams(amp, fx, fz);
+	for (int k = 0; k < OCTAVES; k++) {
+		changed = changed || fx[k] != bakedFx[k] || fz[k] != bakedFz[k];
+		bakedFx[k] = fx[k];
+		bakedFz[k] = fz[k];
+	}
+	return changed;
+}
+
+// Temperature Noise Method
+// @param
+// - x: world x position
+// - z: world z position
+// @description
+// - The full-resolution temperature field. Only called at the lattice points
+//   of the temperature climate layer.
+float Occulus::temperatureNoise(float x, float z) {
+	return open_simplex_noise2(ctx, x / (O_DIM * 1.0) - 0.5, z / (O_DIM * 1.0) - 0.5);
+}
+
+// Map Climate Method
+// @param
+// - i0: the first row of slots
+// - rows: the number of rows
+// - j0: the first column of slots
+// - cols: the number of columns
+// - out: the sectors to fill in, row-major
+// @description
+// - Fills in the base temperature for a block of slots from the coarse
+//   temperature layer. The altitude correction is applied later by combine.
+//   Other low-frequency climate layers should be added here the same way.
+void Occulus::mapClimate(int i0, int rows, int j0, int cols, Sector *out) {
+	Arena &scratch = Arena::local();
+	Arena::Scope scope(scratch);
+	float *xs = scratch.alloc<float>(cols), *zs = scratch.alloc<float>(rows), *vals = scratch.alloc<float>(rows * cols);
+	for (int c = 0; c < cols; c++) {
+		xs[c] = position.x + slotPosition(i0, j0 + c).x;
+	}
+	for (int r = 0; r < rows; r++) {
+		zs[r] = position.z + slotPosition(i0 + r, j0).z;
+	}
+	temperature.sampleGrid(xs, cols, zs, rows, vals);
+	for (int k = 0; k < rows * cols; k++) {
+		out[k].baseTemp = vals[k];
+	}
+}
+
+// Noise Shape Method
+// @description
+// - Gathers the current post-processing and octave settings, for publishing
+//   with the resident map.
+NoiseShape Occulus::noiseShape() const {
+	NoiseShape shape;
+	shape.heightPow = float(heightPow);
+	shape.maxH = float(maxH);
+	octaveParams(shape.amp, shape.fx, shape.fz);
+	return shape;
+}
+
+// Update Level Of Detail Method
+// @description
+// - Works out the weight level of each octave for every slot of the grid from
+//   the slot's distance to the center of the view area. An octave is at full
+//   weight while its wavelength projects to at least 2 * lodPixels pixels and
+//   fades to nothing at lodPixels. Levels are quantized to LOD_LEVELS steps
+//   and depend only on the slot, so blending is deterministic. Also records,
+//   for each direction of motion, the slots whose level differs from the slot
+//   they get shifted from; only those can need work after a move. Both
+//   passes run as jobs, the levels a band of rows each and the edges one
+//   direction each.
+void Occulus::updateLod() {
+	RuntimeGrid grid(dim);
+	float amp[OCTAVES], fx[OCTAVES], fz[OCTAVES];
+	float fadeStart[OCTAVES], fadeEnd[OCTAVES];
+
+	octaveParams(amp, fx, fz);
+	for (int k = 0; k < OCTAVES; k++) {
+		float freq = glm::max(fx[k], fz[k]);
+		float wavelength = freq > 0.0f ? O_DIM / freq : 0.0f;
+		fadeEnd[k] = lodPixels > 0.0 && freq > 0.0f ? wavelength * lodPixelsPerRadian / lodPixels : 0.0f;
+		fadeStart[k] = fadeEnd[k] / 2.0f;
+	}
+
+	lodTarget.resize(grid.count());
+	JobGroup group;
+	for (int i0 = 0; i0 < dim; i0 += C_DIM) {
+		int rows = std::min(C_DIM, dim - i0);
+		jobs.submit(group, jobPriority(i0, rows, 0, dim), [&, i0, rows] {
+			for (int i = i0; i < i0 + rows; i++) {
+				for (int j = 0; j < dim; j++) {
+					vec3 p = slotPosition(i, j);
+					float d = glm::length(vec2(p.x, p.z));
+					unsigned int lod = 0;
+					for (int k = 0; k < OCTAVES; k++) {
+						float w = fadeEnd[k] > 0.0f ? clamp((fadeEnd[k] - d) / (fadeEnd[k] - fadeStart[k]), 0.0f, 1.0f) : 1.0f;
+						lod |= (unsigned int)(roundf(w * LOD_LEVELS)) << (k * 8);
+					}
+					lodTarget[grid.index(i, j)] = lod;
+				}
+			}
+		});
+	}
+	jobs.wait(group);
+
+	const int mov[] = { 0, -1, 1 };
+	for (int dir = 0; dir < 9; dir++) {
+		jobs.submit(group, 0.0f, [&, dir] {
+			const int di = mov[dir / 3], dj = mov[dir % 3];
+			vector<int> &edges = lodEdges[dir];
+			edges.clear();
+			for (int i = std::max(-di, 0); i < dim - std::max(di, 0); i++) {
+				const unsigned int *row = &lodTarget[grid.index(i, 0)];
+				const unsigned int *from = &lodTarget[grid.index(i + di, 0)] + dj;
+				for (int j = std::max(-dj, 0); j < dim - std::max(dj, 0); j++) {
+					if (row[j] != from[j]) {
+						edges.push_back(grid.index(i, j));
+					}
+				}
+			}
+		});
+	}
+	jobs.wait(group);
+}
+
+// Slot Position Method
+// @param
+// - i: the row of the slot
+// - j: the column of the slot
+// @description
+// - Returns the position of a slot of the grid relative to the center of the
+//   view area. Slots never move; the sectors' data is shifted through them.
+vec3 Occulus::slotPosition(int i, int j) {
+	RuntimeGrid grid(dim);
+	return vec3((j + grid.min())*spacing, 0.0f, (i + grid.min())*spacing);
+}
+
+// Job Priority Method
+// @param
+// - i0: the first row of slots
+// - rows: the number of rows
+// - j0: the first column of slots
+// - cols: the number of columns
+// @description
+// - Priority of a job working on a block of slots, lower is more urgent: the
+//   distance in cells from the center of the view area to the center of the
+//   block, doubled for blocks behind the direction of travel. The view area
+//   knows nothing of the camera's frustum, so the heading stands in for
+//   visibility; terrain ahead is what is coming into view.
+float Occulus::jobPriority(int i0, int rows, int j0, int cols) const {
+	RuntimeGrid grid(dim);
+	float x = j0 + cols * 0.5f + grid.min();
+	float z = i0 + rows * 0.5f + grid.min();
+	float d = sqrtf(x * x + z * z);
+	return x * velocity.x + z * velocity.y < 0.0f ? d * 2.0f : d;
 }
 
 // Initialize Map Method
 // @description
 // - Initalizes the view area's map of sectors upon initial creation 
 //   of the view area. This should never be run outside of the 
-//   constructor function.
+//   constructor function. The sectors are laid out in parallel, a band of
+//   rows per job. With a budget only the STARTUP_ROWS rows nearest the
+//   center are generated before returning; the rest start out as the coarse
+//   placeholder and stream in, nearest first, over the first frames.
 void Occulus::initMap() {
-	for (int i = O_MIN; i < O_MAX; i++) {
-		for (int j = O_MIN; j < O_MAX; j++) {
-			Sector newSec = Sector();
-			newSec.init(j*spacing, 0.0f, i*spacing);
-			this->map.push_back(newSec);
-			tuple<float, float> ht = mapNoise(newSec.position);
-			map.back().position.y = get<0>(ht);
-			map.back().temp = get<1>(ht);
+	TRACE_ZONE("initMap");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	RuntimeGrid grid(dim);
+	float amp[OCTAVES];
+	lRawPosition = position;
+	velocity = vec2(0.0f, 0.0f);
+	map.resize(grid.count());
+	JobGroup bands;
+	for (int i0 = 0; i0 < dim; i0 += C_DIM) {
+		int rows = std::min(C_DIM, dim - i0);
+		jobs.submit(bands, jobPriority(i0, rows, 0, dim), [this, i0, rows] {
+			for (int i = i0; i < i0 + rows; i++) {
+				for (int j = 0; j < dim; j++) {
+					map[i * dim + j].init(slotPosition(i, j));
+				}
+			}
+		});
+	}
+	octaveParams(amp, bakedFx, bakedFz);
+	bakedLodPixels = lodPixels;
+	jobs.submit(bands, JOB_BACKGROUND, [this, grid] {
+		tiles.resize(grid.count());
+		pyramid.resize(dim, spacing);
+		resident.resize(dim, spacing);
+	});
+	updateLod();
+	staleRows.assign(dim, 0);
+	staleCount = 0;
+	prefetch.reserve(dim + 2 * PREFETCH_MARGIN); // every line wanted is this long
+	Prefetcher::sizeLine(takenLine, dim + 2 * PREFETCH_MARGIN);
+	edgeRow.reserve(dim);
+	edgeCol.reserve(dim);
+	edgeRowTiles.resize(dim);
+	edgeColTiles.resize(dim);
+	wantLines.reserve(2 * PREFETCH_AHEAD);
+	Arena::local().reserve(ARENA_BLOCK); // this thread helps with jobs while it waits
+	jobs.wait(bands);
+	regenerate();
+	catchUp(start, STARTUP_ROWS);
+}
+
+// Regenerate Method
+// @description
+// - Generates every sector in the map from scratch at the current position.
+//   Used when the map is first built and when the view area jumps too far
+//   for shifting to help. Under a budget the map only gets a coarse
+//   placeholder now and the real rows are generated by catchUp over the
+//   following frames.
+void Occulus::regenerate() {
+	TRACE_ZONE("regenerate");
+	if (budget > 0.0) {
+		placeholder();
+		markStale(STALE_COMBINE | STALE_NOISE | STALE_CLIMATE);
+	}
+	else {
+		mapBands(RuntimeGrid(dim), true, true);
+	}
+	refillLookups();
+}
+
+// Map Bands Method
+// @param
+// - grid: the grid dimensions, either a FixedGrid or a RuntimeGrid
+// - climate: whether to fill in the base temperatures first
+// - reset: whether to throw away the baked noise first
+// @description
+// - Brings every sector up to its level of detail target and combines it,
+//   as one job per band of C_DIM rows with the bands nearest the camera the
+//   most urgent, and waits for them. Only noise that is missing gets
+//   evaluated. Work a budget put off is done too, so nothing is left stale.
+template <class Grid>
+void Occulus::mapBands(const Grid &grid, bool climate, bool reset) {
+	JobGroup bands;
+	const unsigned char stale = STALE_COMBINE | (climate ? STALE_CLIMATE : 0) | (reset ? STALE_NOISE : 0);
+	for (int i0 = 0; i0 < grid.dim(); i0 += C_DIM) {
+		int rows = std::min(C_DIM, grid.dim() - i0);
+		jobs.submit(bands, jobPriority(i0, rows, 0, grid.dim()), [this, &grid, i0, rows, stale] {
+			TRACE_ZONE("map band");
+			for (int i = i0; i < i0 + rows; i++) {
+				mapRow(grid, i, stale | staleRows[i]);
+			}
+		});
+	}
+	jobs.wait(bands);
+	staleRows.assign(dim, 0);
+	staleCount = 0;
+}
+
+// Map Row Method
+// @param
+// - grid: the grid dimensions, either a FixedGrid or a RuntimeGrid
+// - i: the row of slots
+// - stale: the STALE_ flags saying what is out of date
+// @description
+// - Brings one row up to its level of detail target and combines it, after
+//   refilling its base temperatures and throwing away its baked noise if
+//   those are stale. Rows don't overlap, so each can be a job.
+template <class Grid>
+void Occulus::mapRow(const Grid &grid, int i, unsigned char stale) {
+	const int first = grid.index(i, 0);
+	if (stale & STALE_CLIMATE) {
+		mapClimate(i, 1, 0, grid.dim(), map.data() + first);
+	}
+	for (int idx = first; idx < first + grid.dim(); idx++) {
+		if (stale & STALE_NOISE) {
+			map[idx].evaluated = 0;
+		}
+		mapNoise(map[idx], tiles, idx, lodTarget[idx]); // no noise unless something is missing
+	}
+	combineMap(grid, i, 1);
+}
+
+// Placeholder Method
+// @description
+// - Covers the map with a coarse stand-in after a jump, while the budget
+//   holds back the real thing: full sectors every PLACEHOLDER_STEP slots
+//   (and on the last row and column), bilinearly filled in between. Every
+//   sector is left unevaluated, so a shift that moves it to a new level of
+//   detail before catchUp gets to it generates it properly.
+void Occulus::placeholder() {
+	TRACE_ZONE("placeholder");
+	const int step = PLACEHOLDER_STEP;
+	const int n = (dim - 1 + step - 1) / step + 1; // samples along each side
+	int *at = frame.alloc<int>(n); // slot of each sample
+	float *xs = frame.alloc<float>(n), *zs = frame.alloc<float>(n), *temps = frame.alloc<float>(n * n);
+	for (int k = 0; k < n; k++) {
+		at[k] = std::min(k * step, dim - 1);
+		xs[k] = position.x + slotPosition(0, at[k]).x;
+		zs[k] = position.z + slotPosition(at[k], 0).z;
+	}
+	temperature.sampleGrid(xs, n, zs, n, temps);
+
+	Sector *samples = frame.alloc<Sector>(n * n);
+	sampleTiles.resize(n * n);
+	JobGroup group;
+	for (int a = 0; a < n; a++) {
+		jobs.submit(group, jobPriority(at[a], 1, 0, dim), [&, a] {
+			for (int b = 0; b < n; b++) {
+				Sector &sec = samples[a * n + b];
+				sec.init(slotPosition(at[a], at[b]));
+				sec.baseTemp = temps[a * n + b];
+				mapNoise(sec, sampleTiles, a * n + b, lodTarget[at[a] * dim + at[b]]);
+				combine(sec, sampleTiles, a * n + b);
+			}
+		});
+	}
+	jobs.wait(group);
+
+	for (int i0 = 0; i0 < dim; i0 += C_DIM) {
+		int rows = std::min(C_DIM, dim - i0);
+		jobs.submit(group, jobPriority(i0, rows, 0, dim), [&, i0, rows] {
+			for (int i = i0; i < i0 + rows; i++) {
+				int a = std::min(i / step, n - 2);
+				float tz = float(i - at[a]) / (at[a + 1] - at[a]);
+				for (int j = 0; j < dim; j++) {
+					int b = std::min(j / step, n - 2);
+					float tx = float(j - at[b]) / (at[b + 1] - at[b]);
+					const Sector &s00 = samples[a * n + b], &s01 = samples[a * n + b + 1];
+					const Sector &s10 = samples[(a + 1) * n + b], &s11 = samples[(a + 1) * n + b + 1];
+					float w00 = (1.0f - tx) * (1.0f - tz), w01 = tx * (1.0f - tz);
+					float w10 = (1.0f - tx) * tz, w11 = tx * tz;
+					Sector &sec = map[i * dim + j];
+					sec.position.y = s00.position.y * w00 + s01.position.y * w01 + s10.position.y * w10 + s11.position.y * w11;
+					sec.temp = s00.temp * w00 + s01.temp * w01 + s10.temp * w10 + s11.temp * w11;
+					sec.baseTemp = s00.baseTemp * w00 + s01.baseTemp * w01 + s10.baseTemp * w10 + s11.baseTemp * w11;
+					sec.normal = glm::normalize(s00.normal * w00 + s01.normal * w01 + s10.normal * w10 + s11.normal * w11);
+					sec.evaluated = 0;
+					sec.lod = lodTarget[i * dim + j]; // only real level changes regenerate it early
+				}
+			}
+		});
+	}
+	jobs.wait(group);
+}
+
+// Mark Stale Method
+// @param
+// - flags: the STALE_ flags to add to every row
+// @description
+// - Puts off work on the whole map for catchUp to do.
+void Occulus::markStale(unsigned char flags) {
+	for (int i = 0; i < dim; i++) {
+		if (!staleRows[i]) {
+			staleCount++;
 		}
+		staleRows[i] |= flags;
 	}
 }
 
+// Shift Stale Method
+// @param
+// - zDir: movement flags for the z-direction
+// @description
+// - Moves the stale flags along with their rows after a shift. The new edge
+//   row is freshly generated so it starts out up to date; a new column
+//   leaves the flags alone, as its rows still have stale sectors.
+void Occulus::shiftStale(int zDir) {
+	if (!staleCount || !zDir) {
+		return;
+	}
+	const int replace[] = { -1, 0, dim - 1 };
+	const int gone = dim - 1 - replace[zDir]; // the row shifted out of the map
+	if (staleRows[gone]) {
+		staleCount--;
+	}
+	if (zDir == 1) {
+		std::copy_backward(staleRows.begin(), staleRows.end() - 1, staleRows.end());
+	}
+	else {
+		std::copy(staleRows.begin() + 1, staleRows.end(), staleRows.begin());
+	}
+	staleRows[replace[zDir]] = 0;
+}
+
+// Catch Up Method
+// @param
+// - start: when the frame's generation started
+// - minRows: rows to do whatever the budget says
+// @description
+// - Does the work the budget put off, a batch of rows at a time with the
+//   rows nearest the camera first, until the frame has used its budget. At
+//   least one batch is done every frame so the backlog always drains; a
+//   frame overshoots its budget by at most one batch. Without a budget it
+//   does everything.
+// - The order is by row, not by 2D distance: a row is done across its full
+//   width before any farther row. Stale work is tracked per row because a
+//   shift moves whole rows; per tile, every column shift would have to
+//   merge neighbouring tiles' flags.
+void Occulus::catchUp(std::chrono::steady_clock::time_point start, int minRows) {
+	if (!staleCount) {
+		return;
+	}
+	TRACE_ZONE("catch up");
+	RuntimeGrid grid(dim);
+	std::pair<float, int> *order = frame.alloc<std::pair<float, int> >(dim); // stale rows, most urgent first
+	int count = 0;
+	for (int i = 0; i < dim; i++) {
+		if (staleRows[i]) {
+			order[count++] = std::make_pair(jobPriority(i, 1, 0, dim), i);
+		}
+	}
+	std::sort(order, order + count);
+
+	const int batch = jobs.workers() + 1; // a row for each worker and one for this thread
+	int next = 0;
+	int *done = frame.alloc<int>(batch);
+	do {
+		JobGroup rows;
+		int n = 0;
+		for (; n < batch && next < count; n++, next++) {
+			int i = order[next].second;
+			unsigned char stale = staleRows[i];
+			jobs.submit(rows, order[next].first, [this, &grid, i, stale] {
+				TRACE_ZONE("stale row");
+				mapRow(grid, i, stale);
+			});
+			done[n] = i;
+		}
+		jobs.wait(rows);
+		for (int d = 0; d < n; d++) {
+			staleRows[done[d]] = 0;
+			staleCount--;
+		}
+		trackRows(done, n);
+	} while (next < count && (next < minRows || budget <= 0.0 ||
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() < budget));
+}
+
+// Track Rows Method
+// @param
+// - rows: the rows of slots that changed
+// - count: the number of rows
+// @description
+// - Feeds the height pyramid and the resident map whole rows of sectors
+//   that were regenerated in place, without moving them.
+void Occulus::trackRows(const int *rows, int count) {
+	resident.beginWrite();
+	resident.setShape(noiseShape());
+	for (int r = 0; r < count; r++) {
+		int i = rows[r];
+		for (int j = 0; j < dim; j++) {
+			const Sector &sec = map[i * dim + j];
+			pyramid.set(gridOrigin.x + j, gridOrigin.y + i, sec.position.y);
+			resident.set(gridOrigin.x + j, gridOrigin.y + i, sec.position.y, sec.temp);
+		}
+	}
+	resident.endWrite();
+}
+
 // Update Map Method
 // @description
 // - Updates noise-based parameters for each sector when the update function 
 //   is called.
 void Occulus::updateMap() {
+	TRACE_ZONE("updateMap");
+	// a jump of more than one cell can't be shifted in, start over
+	vec3 cells = (position - lPosition) / spacing;
+	if (fabsf(cells.x) > 1.5f || fabsf(cells.z) > 1.5f) {
+		regenerate();
+		lPosition = position;
+		return;
+	}
+
 	// calculate motion based on flags
 	int flags = calcFlags();
 
 	// if we aren't moving, we don't need to do anything, so only run if we're moving
 	if (flags) {
-		// spin up threads to do noise calculations while we're copying our map
-		copyFinished.lock();
-
-		std::thread rowThread(&Occulus::runGenRow, this);
-		std::thread colThread(&Occulus::runGenCol, this);
-		int until[] = { O_DIM, 0, O_DIM }; // array holding the terminating conditions for our loops
-		int start[] = { 0, O_DIM - 1, 0 }; // array holding the starting values for our loops
-		int inc[] = { 1, -1, 1 }; // array holding the increment values for our loops
-		int mov[] = { 0, -1, 1 }; // array holding the shift direction for our loops
+		const int mov[] = { 0, -1, 1 };
+		const int replace[] = { -1, 0, dim - 1 };
 		int zDir = flags & 3; // extract flags for z-direction
 		int xDir = (flags >> 2) & 3; // extract flags for x-direction
+		gridOrigin += glm::ivec2(mov[xDir], mov[zDir]); // new edges are looked up by it
+
+		// queue the new row and column as jobs while we shift the map
+		JobGroup edgeJobs;
+		vector<Sector> &row = edgeRow, &col = edgeCol;
+		OctaveTiles &rowTiles = edgeRowTiles, &colTiles = edgeColTiles;
+		row.clear();
+		col.clear();
+		genRow(edgeJobs, zDir, row, rowTiles);
+		genCol(edgeJobs, xDir, col, colTiles);
+
+		{
+			TRACE_ZONE("shift");
+			shift(zDir, xDir);
+		}
+
+		{
+			TRACE_ZONE("wait for workers");
+			jobs.wait(edgeJobs);
+		}
 
-									 // create a vector of lambda functions to help with end conditions in the for loops
-		auto ops = [](int i, int x, int flag)->bool { if (flag % 2 == 0) { return i < x; } else { return i > x; }return false; };
+		shiftStale(zDir);
 
-		for (int i = start[zDir]; ops(i, until[zDir],zDir); i += inc[zDir]) {
-			for (int j = start[xDir]; ops(j, until[xDir],xDir); j += inc[xDir]) {
-				map[i * O_DIM + j].copy(map[(i + mov[zDir]) * O_DIM + (j + mov[xDir])]);
+		{
+			TRACE_ZONE("copy edges");
+			for (int i = 0; i < (int)row.size(); i++) {
+				int idx = replace[zDir] * dim + i;
+				map[idx].copy(row[i]);
+				tiles.copy(idx, rowTiles, i);
+			}
+			for (int i = 0; i < (int)col.size(); i++) {
+				int idx = i * dim + replace[xDir];
+				map[idx].copy(col[i]);
+				tiles.copy(idx, colTiles, i);
 			}
 		}
 
-		// mark copy operations finished
-		copyFinished.unlock();
-
-		rowThreadFinished.lock();
-		colThreadFinished.lock();
-		rowThreadFinished.unlock();
-		colThreadFinished.unlock();
-		rowThread.join();
-		colThread.join();
+		// sectors that moved across a level of detail boundary pick up or drop octaves
+		TRACE_ZONE("lod edges");
+		const vector<int> &edges = lodEdges[zDir * 3 + xDir];
+		for (size_t e = 0; e < edges.size(); e++) {
+			int idx = edges[e];
+			if (map[idx].lod != lodTarget[idx]) {
+				mapNoise(map[idx], tiles, idx, lodTarget[idx]);
+				combine(map[idx], tiles, idx);
+			}
+		}
+		trackLookups(zDir, xDir);
 		lPosition = position;
 	}
 }
 
+// Refill Lookups Method
+// @description
+// - Places the height pyramid and the resident map at the current position
+//   and feeds them every sector, for when the whole map has changed. The
+//   pyramid is rebuilt at its next query.
+void Occulus::refillLookups() {
+	TRACE_ZONE("refill lookups");
+	RuntimeGrid grid(dim);
+	int gx = (int)roundf(position.x / spacing) + grid.min();
+	int gz = (int)roundf(position.z / spacing) + grid.min();
+	vec2 offset = vec2(position.x, position.z) - vec2(gx - grid.min(), gz - grid.min()) * spacing;
+	gridOrigin = glm::ivec2(gx, gz);
+	pyramid.reset(gx, gz, offset);
+	resident.beginWrite();
+	resident.place(gx, gz, offset);
+	resident.setShape(noiseShape());
+	for (int i = 0; i < dim; i++) {
+		for (int j = 0; j < dim; j++) {
+			const Sector &sec = map[grid.index(i, j)];
+			pyramid.set(gx + j, gz + i, sec.position.y);
+			resident.set(gx + j, gz + i, sec.position.y, sec.temp);
+		}
+	}
+	resident.endWrite();
+}
+
+// Track Lookups Method
+// @param
+// - zDir: movement flags for the z-direction (0 none, 1 forward, 2 backward)
+// - xDir: movement flags for the x-direction (0 none, 1 left, 2 right)
+// @description
+// - Moves the height pyramid and the resident map along with the map after a
+//   shift and feeds them the sectors that changed: the new edge row and
+//   column, and the level of detail edges. Their origin is the grid origin,
+//   which follows the shift rather than the position so it always matches
+//   the sectors that were actually moved. The pyramid recomputes nothing
+//   until its next query; the resident map publishes the whole move at once.
+void Occulus::trackLookups(int zDir, int xDir) {
+	TRACE_ZONE("track lookups");
+	RuntimeGrid grid(dim);
+	const int replace[] = { -1, 0, dim - 1 };
+	glm::ivec2 g = gridOrigin;
+	vec2 offset = vec2(position.x, position.z) - vec2(g.x - grid.min(), g.y - grid.min()) * spacing;
+	pyramid.moveTo(g.x, g.y, offset);
+	resident.beginWrite();
+	resident.place(g.x, g.y, offset);
+	resident.setShape(noiseShape());
+	if (zDir) {
+		for (int j = 0; j < dim; j++) {
+			const Sector &sec = map[grid.index(replace[zDir], j)];
+			pyramid.set(g.x + j, g.y + replace[zDir], sec.position.y);
+			resident.set(g.x + j, g.y + replace[zDir], sec.position.y, sec.temp);
+		}
+	}
+	if (xDir) {
+		for (int i = 0; i < dim; i++) {
+			const Sector &sec = map[grid.index(i, replace[xDir])];
+			pyramid.set(g.x + replace[xDir], g.y + i, sec.position.y);
+			resident.set(g.x + replace[xDir], g.y + i, sec.position.y, sec.temp);
+		}
+	}
+	const vector<int> &edges = lodEdges[zDir * 3 + xDir];
+	int i = 0; // edges are in slot order, so the row only moves forwards
+	for (size_t e = 0; e < edges.size(); e++) {
+		int idx = edges[e];
+		while (idx >= (i + 1) * dim) {
+			i++;
+		}
+		pyramid.set(g.x + idx - i * dim, g.y + i, map[idx].position.y);
+		resident.set(g.x + idx - i * dim, g.y + i, map[idx].position.y, map[idx].temp);
+	}
+	resident.endWrite();
+}
+
+// Shift Method
+// @param
+// - zDir: movement flags for the z-direction (0 none, 1 forward, 2 backward)
+// - xDir: movement flags for the x-direction (0 none, 1 left, 2 right)
+// @description
+// - Runtime-sized map shift. FixedOcculus overrides this with a compile-time
+//   sized version of the same kernel.
+void Occulus::shift(int zDir, int xDir) {
+	shiftMap(RuntimeGrid(dim), zDir, xDir);
+}
+
+// Shift Map Method
+// @param
+// - grid: the grid dimensions, either a FixedGrid or a RuntimeGrid
+// - zDir: movement flags for the z-direction
+// - xDir: movement flags for the x-direction
+// @description
+// - Moves every sector's height and temperature one cell against the direction
+//   of motion. Rows and columns are walked so that each source is read before
+//   it is overwritten; the edge row and column are left for runGenRow and
+//   runGenCol to fill in. The octave tiles move the same way, a row at a time.
+template <class Grid>
+void Occulus::shiftMap(const Grid &grid, int zDir, int xDir) {
+	const int mov[] = { 0, -1, 1 }; // array holding the shift direction for each flag
+	const int n = grid.dim();
+	const int dz = mov[zDir];
+	const int dx = mov[xDir];
+
+	// the first and last row/column we write, and the direction we walk in
+	const int iFirst = dz < 0 ? n - 1 : 0;
+	const int iLast = dz > 0 ? n - 1 : (dz < 0 ? 0 : n);
+	const int iStep = dz < 0 ? -1 : 1;
+	const int jFirst = dx < 0 ? n - 1 : 0;
+	const int jLast = dx > 0 ? n - 1 : (dx < 0 ? 0 : n);
+	const int jStep = dx < 0 ? -1 : 1;
+
+	for (int i = iFirst; i != iLast; i += iStep) {
+		Sector *dst = map.data() + grid.index(i, 0);
+		const Sector *src = map.data() + grid.index(i + dz, 0);
+		for (int j = jFirst; j != jLast; j += jStep) {
+			dst[j].copy(src[j + dx]);
+		}
+	}
+
+	const int jFrom = dx < 0 ? 1 : 0; // first column written
+	const int span = dx != 0 ? n - 1 : n;
+	for (int t = 0; t < OctaveTiles::TILES; t++) {
+		float *data = tiles.tile(t).data();
+		for (int i = iFirst; i != iLast; i += iStep) {
+			memmove(data + grid.index(i, jFrom), data + grid.index(i + dz, jFrom + dx), span * sizeof(float));
+		}
+	}
+}
+
 // Refresh Method
 // @description 
 // - Refreshes the entire map, mainly used for handling updates to noise function parameters via the GUI. For
 //   updating the map every frame the update function should be called.
 void Occulus::refresh() {
+	refreshMap(RuntimeGrid(dim));
+}
+
+// Refresh Map Method
+// @param
+// - grid: the grid dimensions, either a FixedGrid or a RuntimeGrid
+// @description
+// - Brings every sector in the map up to date with the current parameters.
+//   The baked octaves are only thrown away when an octave frequency changed,
+//   and levels of detail only rebuilt when the frequencies or lodPixels did;
+//   otherwise this is just a combine pass over the tiles. The climate layers
+//   have no parameters so they are left alone. Under a budget the rows are
+//   only marked stale and caught up on nearest first, see setBudget.
+template <class Grid>
+void Occulus::refreshMap(const Grid &grid) {
+	TRACE_ZONE("refresh");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	frame.reset();
 	if (map.size()) {
-		for (int i = 0; i < O_DIM; i++) {
-			for (int j = 0; j < O_DIM; j++) {
-				int idx = i*O_DIM + j;
-				tuple<float, float> ht = mapNoise(map[idx].position);
-				map[idx].position.y = get<0>(ht);
-				map[idx].temp = get<1>(ht);
-			}
+		bool rebake = bakeChanged();
+		if (rebake || bakedLodPixels != lodPixels) {
+			bakedLodPixels = lodPixels;
+			updateLod();
+		}
+		if (rebake) {
+			prefetch.invalidate();
+		}
+		if (budget > 0.0) {
+			markStale(rebake ? STALE_COMBINE | STALE_NOISE : STALE_COMBINE);
+			catchUp(start);
+		}
+		else {
+			mapBands(grid, false, rebake);
+			refillLookups();
 		}
 	}
 }
@@ -161,14 +1001,161 @@ void Occulus::refresh() {
 // @description
 // - Updates the position of the view area, calls the updateMap() method ot update the height map
 //   and temperature map, and then calls the draw and smooth shading functions.
-void Occulus::update(vec3 pos, vector<float> &heights, vector<vec4> &normals, vector<float> &temps, vector<uvec3> &faces) {
+void Occulus::update(vec3 pos, vector<float> &heights, vector<vec4> &normals, vector<float> &temps) {
+	move(pos);
+	draw(normals, temps, heights);
+}
+
+// Move Method
+// @param
+// - pos: the new position of the occulus
+// @description
+// - The generation half of update: snaps the position to the grid and brings
+//   the map up to date, without touching the attribute arrays. The velocity
+//   is tracked from the unsnapped positions, so slow motion that only crosses
+//   a cell every few moves still registers, and the lines it is heading for
+//   are queued for prefetching. Whatever is left of the budget goes to work
+//   put off by earlier frames.
+void Occulus::move(vec3 pos) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	frame.reset();
+	vec2 step((pos.x - lRawPosition.x) / spacing, (pos.z - lRawPosition.z) / spacing);
+	lRawPosition = pos;
+	if (fabsf(step.x) > 1.5f || fabsf(step.y) > 1.5f) {
+		velocity = vec2(0.0f, 0.0f); // a jump, not motion
+	} else {
+		velocity += (step - velocity) * PREFETCH_SMOOTHING;
+	}
+
 	vec3 snappedPos = pos;
 	snappedPos.x = roundf(snappedPos.x / spacing) * spacing;
 	snappedPos.z = roundf(snappedPos.z / spacing) * spacing;
 	position.x = snappedPos.x;
 	position.z = snappedPos.z;
 	updateMap();
-	draw(normals, temps, heights, faces);
+	prefetchAhead();
+	catchUp(start);
+}
+
+// Set Budget Method
+// @param
+// - ms: milliseconds of generation each move or refresh may take, 0 for no
+//   limit
+// @description
+// - Under a budget, work on the whole map (a refresh, or regenerating after
+//   a jump) is put off row by row and caught up on over the following
+//   frames, nearest rows first. Until a row is caught up it shows its
+//   last-known heights, or a coarse placeholder after a jump. The per-move
+//   shift is always done in full. Lifting the budget catches up on the next
+//   move.
+void Occulus::setBudget(double ms) {
+	budget = ms;
+}
+
+// Settled Method
+// @description
+// - Whether the map is fully up to date, with no work put off by the budget.
+bool Occulus::settled() const {
+	return staleCount == 0;
+}
+
+// Prefetch Ahead Method
+// @description
+// - Tells the prefetcher which rows and columns the view area is heading
+//   for. Along each axis it moves on, the lines just past the edge it moves
+//   towards are wanted, nearest first: enough of them to cover PREFETCH_LEAD
+//   moves at the current speed, up to PREFETCH_AHEAD. Each line runs
+//   PREFETCH_MARGIN sectors past the view area at both ends so it still
+//   fits after some sideways drift.
+void Occulus::prefetchAhead() {
+	RuntimeGrid grid(dim);
+	vector<PrefetchLine> &lines = wantLines;
+	PrefetchLine line;
+	lines.clear();
+	line.offset = vec2(position.x, position.z) - vec2(gridOrigin.x - grid.min(), gridOrigin.y - grid.min()) * spacing;
+	line.spacing = spacing;
+	line.length = dim + 2 * PREFETCH_MARGIN;
+	for (int k = 0; k < OCTAVES; k++) {
+		line.fx[k] = bakedFx[k];
+		line.fz[k] = bakedFz[k];
+	}
+	for (int axis = 0; axis < 2; axis++) {
+		float v = axis ? velocity.x : velocity.y;
+		int along = axis ? gridOrigin.x : gridOrigin.y; // grid coordinate of the first line in the view
+		int across = axis ? gridOrigin.y : gridOrigin.x;
+		if (fabsf(v) < PREFETCH_MIN_SPEED) {
+			continue;
+		}
+		int ahead = std::min(PREFETCH_AHEAD, (int)ceilf(fabsf(v) * PREFETCH_LEAD));
+		line.axis = axis;
+		line.start = across - PREFETCH_MARGIN;
+		for (int n = 1; n <= ahead; n++) {
+			line.line = v > 0.0f ? along + dim - 1 + n : along - n;
+			lines.push_back(line);
+		}
+	}
+	prefetch.want(lines);
+}
+
+// Bake Line Method
+// @param
+// - line: the line to generate, its data is filled in
+// @description
+// - Prefetcher callback, runs on its workers. Fills in the base temperature
+//   and the raw noise of every octave for each sector of the line, the same
+//   way mapClimate and mapNoise do for a slot. Only reads the noise context,
+//   the temperature layer and the line itself.
+void Occulus::bakeLine(PrefetchLine &line) {
+	int n = line.length;
+	Arena &scratch = Arena::local();
+	Arena::Scope scope(scratch);
+	float *xs = scratch.alloc<float>(line.axis ? 1 : n), *zs = scratch.alloc<float>(line.axis ? n : 1);
+	for (int k = 0; k < n; k++) {
+		float along = line.offset[line.axis] + (line.start + k) * line.spacing;
+		(line.axis ? zs[k] : xs[k]) = along;
+	}
+	(line.axis ? xs[0] : zs[0]) = line.offset[1 - line.axis] + line.line * line.spacing;
+	line.baseTemp.resize(n);
+	temperature.sampleGrid(xs, line.axis ? 1 : n, zs, line.axis ? n : 1, &line.baseTemp[0]);
+
+	line.tiles.resize(n);
+	double ddx, ddz;
+	for (int k = 0; k < n; k++) {
+		float nx = xs[line.axis ? 0 : k] / (O_DIM * 1.0) - 0.5;
+		float nz = zs[line.axis ? k : 0] / (O_DIM * 1.0) - 0.5;
+		for (int o = 0; o < OCTAVES; o++) {
+			float v = open_simplex_noise2_deriv(ctx, nx * line.fx[o], nz * line.fz[o], &ddx, &ddz);
+			line.tiles.set(o, k, v, ddx, ddz);
+		}
+	}
+}
+
+// Take Line Method
+// @param
+// - axis: 0 for a row, 1 for a column
+// - slot: the row or column of slots being generated
+// - out: the new sectors, already initialized
+// - outTiles: their raw noise, already sized
+// @description
+// - Fills in the new row or column from a prefetched line if one covers it:
+//   the base temperature and every octave, all marked evaluated. The
+//   sectors still need their level of detail set and combining. Returns
+//   false if nothing was prefetched, and the caller generates them itself.
+bool Occulus::takeLine(int axis, int slot, vector<Sector> &out, OctaveTiles &outTiles) {
+	PrefetchLine &line = takenLine;
+	int at = axis ? gridOrigin.x + slot : gridOrigin.y + slot;
+	int start = axis ? gridOrigin.y : gridOrigin.x;
+	if (!prefetch.take(axis, at, start, dim, line)) {
+		return false;
+	}
+	TRACE_ZONE("take prefetched line");
+	for (int i = 0; i < dim; i++) {
+		int k = start + i - line.start;
+		out[i].baseTemp = line.baseTemp[k];
+		out[i].evaluated = (1 << OCTAVES) - 1;
+		outTiles.copy(i, line.tiles, k);
+	}
+	return true;
 }
 
 // Draw Method (Public)
@@ -178,426 +1165,320 @@ void Occulus::update(vec3 pos, vector<float> &heights, vector<vec4> &normals, ve
 // - uvs: location of the uv map for the view area
 // - temps: location of the temperature map for the view area
 // - heights: location of the height map for the view area
-// - faces: location of the face map for the view area
+// - faces: location of the face map shared by every chunk
 // @description
 // - Public draw function, called when program is first loaded and used to initialize 
 //   global map vectors. This function is not called by update and should not be 
 //   called every frame as doing so would result in a large amount of redundant 
-//   calculations.
+//   calculations. Normals come straight from the sectors, which get exact
+//   normals from the noise derivatives when they are generated.
+// - The view area is meshed as C_DIM square chunks stored one after another,
+//   each with its own copy of its edge vertices, so every chunk has
+//   chunkSize() vertices and one face map with 16-bit indices serves them
+//   all when drawn with chunk * chunkSize() as the base vertex. Chunks on a
+//   ragged edge collapse onto it. The face map is reordered for the
+//   post-transform vertex cache before returning.
 void Occulus::draw(vector<vec4> &vertices, vector<vec4> &normals, vector<vec2> &uvs,
 	vector<float> &temps, vector<float> &heights, vector<uvec3> &faces) {
-	int indNum = 0;
-	int limit = O_DIM - 1;
-	std::map<int, int> indexMap;
-	indexMap.clear(); // clear our map and get ready to init water
-
-	std::map<int, int>::iterator it; // create an iterator to check for existence of keys in map
-
-	for (int i = 0; i < limit; i++) {
-		for (int j = 0; j < limit; j++) {
-			// get index positions from global grid
-			float ind1 = i*O_DIM + j;
-			float ind2 = i*O_DIM + (j + 1);
-			float ind3 = (i + 1)*O_DIM + j;
-			float ind4 = (i + 1)*O_DIM + (j + 1);
-
-			// create two faces
-			uvec3 f1 = uvec3(0, 0, 0);
-			uvec3 f2 = uvec3(0, 0, 0);
-
-			vec3 p1 = map[ind1].position;
-			vec3 p2 = map[ind2].position;
-			vec3 p3 = map[ind3].position;
-			vec3 p4 = map[ind4].position;
-
-			vec3 n1 = calcNormal(p1, p3, p2);
-			vec3 n2 = calcNormal(p4, p2, p3);
-
-			// calculate the UV values for each point
-			float xfac = j*1.0;
-			float yfac = i*1.0;
-			vec2 p1Uv = vec2(UVX_MIN + xfac, UVY_MIN + yfac);
-			vec2 p2Uv = vec2(UVX_MAX + xfac, UVY_MIN + yfac);
-			vec2 p3Uv = vec2(UVX_MIN + xfac, UVY_MAX + yfac);
-			vec2 p4Uv = vec2(UVX_MAX + xfac, UVY_MAX + yfac);
-
-			// Check for existence of ind1 in our map
-			it = indexMap.find(ind1);
-			if (it != indexMap.end())
-			{
-				// calculate the index
-				int idx = it->second;
-
-				// set properties for p1
-				f1.x = idx;
-				normals[idx].x += n1.x;
-				normals[idx].y += n1.y;
-				normals[idx].z += n1.z;
-			}
-			else {
-				// add properties to p1 to arrays and then increment our index
-				f1.x = indNum;
-				vertices.push_back(vec4(p1, 1.0));
-				indexes.push_back(ind1);
-				normals.push_back(vec4(n1, 1.0));
-				uvs.push_back(p1Uv);
-				temps.push_back(map[ind1].temp);
-				heights.push_back(map[ind1].position.y);
-				indexMap.insert({ ind1, indNum });
-				indNum++;
-			}
-
-			// Check for the existence of ind2 in our map
-			it = indexMap.find(ind2);
-			if (it != indexMap.end())
-			{
-				// calculate the index
-				int idx = it->second;
-
-				// set properties for p2
-				f1.y = idx;
-				normals[idx].x += n1.x;
-				normals[idx].y += n1.y;
-				normals[idx].z += n1.z;
-
-				// set properties for p6
-				f2.z = idx;
-				normals[idx].x += n2.x;
-				normals[idx].y += n2.y;
-				normals[idx].z += n2.z;
-			}
-			else {
-				// add properties to p2 to arrays
-				f1.y = indNum;
-				vertices.push_back(vec4(p2, 1.0));
-				indexes.push_back(ind2);
-				normals.push_back(vec4(n1, 1.0));
-				temps.push_back(map[ind2].temp);
-				heights.push_back(map[ind2].position.y);
-				uvs.push_back(p2Uv);
-
-
-				// add properties for p6 to arrays
-				f2.z = indNum;
-				normals[indNum].x += n2.x;
-				normals[indNum].y += n2.y;
-				normals[indNum].z += n2.z;
-
-				// add index to map and increment index
-				indexMap.insert({ ind2, indNum });
-				indNum++;
-			}
-
-			// Check for the existence of ind3 in our map
-			it = indexMap.find(ind3);
-			if (it != indexMap.end())
-			{
-				// calculate the index
-				int idx = it->second;
-
-				// set properties for p3
-				f1.z = idx;
-				normals[idx].x += n1.x;
-				normals[idx].y += n1.y;
-				normals[idx].z += n1.z;
-
-				// set properties for p4
-				f2.x = idx;
-				normals[idx].x += n2.x;
-				normals[idx].y += n2.y;
-				normals[idx].z += n2.z;
-			}
-			else {
-				// add properties to p3 to arrays
-				f1.z = indNum;
-				vertices.push_back(vec4(p3, 1.0));
-				indexes.push_back(ind3);
-				normals.push_back(vec4(n1, 1.0));
-				temps.push_back(map[ind3].temp);
-				heights.push_back(map[ind3].position.y);
-				uvs.push_back(p3Uv);
-
-				// add properties for p6 to arrays
-				f2.x = indNum;
-				normals[indNum].x += n2.x;
-				normals[indNum].y += n2.y;
-				normals[indNum].z += n2.z;
-
-				// increment index
-				indexMap.insert({ ind3, indNum });
-				indNum++;
-			}
-
-			// Check for existence of ind4 in our map
-			it = indexMap.find(ind4);
-			if (it != indexMap.end())
-			{
-				// calculate the index
-				int idx = it->second;
-
-				// set properties for p1
-				f2.y = idx;
-				normals[idx].x += n2.x;
-				normals[idx].y += n2.y;
-				normals[idx].z += n2.z;
+	const int n = chunksPerSide();
+	const int side = C_DIM + 1; // vertices along a chunk edge
+	indexes.clear();
+	for (int ci = 0; ci < n; ci++) {
+		for (int cj = 0; cj < n; cj++) {
+			for (int a = 0; a < side; a++) {
+				for (int b = 0; b < side; b++) {
+					int i = std::min(ci * C_DIM + a, dim - 1);
+					int j = std::min(cj * C_DIM + b, dim - 1);
+					const Sector &sec = map[i * dim + j];
+					vertices.push_back(vec4(sec.position, 1.0));
+					indexes.push_back(i * dim + j);
+					normals.push_back(vec4(sec.normal, 1.0));
+					uvs.push_back(vec2(j * 1.0, i * 1.0));
+					temps.push_back(sec.temp);
+					heights.push_back(sec.position.y);
+				}
 			}
-			else {
-				// add properties to p1 to arrays and then increment our index
-				f2.y = indNum;
-				vertices.push_back(vec4(p4, 1.0));
-				indexes.push_back(ind4);
-				normals.push_back(vec4(n2, 1.0));
-				uvs.push_back(p4Uv);
-				temps.push_back(map[ind4].temp);
-				heights.push_back(map[ind4].position.y);
-				indexMap.insert({ ind4, indNum });
-				indNum++;
-			}
-
-			// push our faces
-			faces.push_back(f1);
-			int temp = f2.x;
-			f2.x = f2.y;
-			f2.y = temp;
-			faces.push_back(f2);
 		}
 	}
 
-	// normalize vectors to accomplish smooth shading
-	int normSize = normals.size();
-	for (int i = 0; i < normSize; i++) {
-		vec3 n = vec3(normals[i].x, normals[i].y, normals[i].z);
-		n = glm::normalize(n);
-		normals[i].x = n.x;
-		normals[i].y = n.y;
-		normals[i].z = n.z;
+	// push our faces, for one chunk
+	for (int a = 0; a < C_DIM; a++) {
+		for (int b = 0; b < C_DIM; b++) {
+			int v[] = { a*side + b, a*side + (b + 1), (a + 1)*side + b, (a + 1)*side + (b + 1) };
+			faces.push_back(uvec3(v[0], v[1], v[2]));
+			faces.push_back(uvec3(v[3], v[2], v[1]));
+		}
 	}
+
+	// the chunks never change shape, so the face order is tuned once here
+	optimizeFaces(faces, chunkSize());
 }
 
 // Draw Water Method
 // @param
 // - vertices: the location of the vertices making up our water
-// - normals: the location of the normal map for our water
 // - uvs: the location of the UV map for our water
-// - faces: the location of our vertex indicies
+// - faces: the location of the index pattern shared by every water chunk
+// @description
+// - Builds the water surface with the same chunks as the terrain, but with a
+//   quad every WATER_STEP sectors. As with the terrain, one face map serves
+//   every chunk with chunk * waterChunkSize() as the base vertex. The layout
+//   only depends on dim, so this runs once and waterChunks picks the chunks
+//   to draw each frame.
 void Occulus::drawWater(vector<vec4> &vertices, vector<vec2> &uvs, vector<uvec3>&faces) {
-	int indNum = 0;
-	int limit = O_DIM - 1;
-	std::map<int, int> indexMap;
-	std::map<int, int>::iterator it; // create an iterator to check for existence of keys in map
-
-	for (int i = 0; i < limit; i++) {
-		for (int j = 0; j < limit; j++) {
-			// get index positions from global grid
-			float ind1 = i*O_DIM + j;
-			float ind2 = i*O_DIM + (j + 1);
-			float ind3 = (i + 1)*O_DIM + j;
-			float ind4 = (i + 1)*O_DIM + (j + 1);
-
-			// create two faces
-			uvec3 f1 = uvec3(0, 0, 0);
-			uvec3 f2 = uvec3(0, 0, 0);
-
-			vec3 p1 = map[ind1].position;
-			vec3 p2 = map[ind2].position;
-			vec3 p3 = map[ind3].position;
-			vec3 p4 = map[ind4].position;
-
-			p1.y = 0.0;
-			p2.y = 0.0;
-			p3.y = 0.0;
-			p4.y = 0.0;
-
-			// calculate the UV values for each point
-			float xfac = j*1.0;
-			float yfac = i*1.0;
-			vec2 p1Uv = vec2(UVX_MIN + xfac, UVY_MIN + yfac);
-			vec2 p2Uv = vec2(UVX_MAX + xfac, UVY_MIN + yfac);
-			vec2 p3Uv = vec2(UVX_MIN + xfac, UVY_MAX + yfac);
-			vec2 p4Uv = vec2(UVX_MAX + xfac, UVY_MAX + yfac);
-
-			// Check for existence of ind1 in our map
-			it = indexMap.find(ind1);
-			if (it != indexMap.end())
-			{
-				// calculate the index
-				int idx = it->second;
-
-				// set properties for p1
-				f1.x = idx;
-			}
-			else {
-				// add properties to p1 to arrays and then increment our index
-				f1.x = indNum;
-				vertices.push_back(vec4(p1, 1.0));
-				uvs.push_back(p1Uv);
-				indexMap.insert({ ind1, indNum });
-				indNum++;
-			}
-
-			// Check for the existence of ind2 in our map
-			it = indexMap.find(ind2);
-			if (it != indexMap.end())
-			{
-				// calculate the index
-				int idx = it->second;
-
-				// set properties for p2
-				f1.y = idx;
-
-				// set properties for p6
-				f2.z = idx;
-			}
-			else {
-				// add properties to p2 to arrays
-				f1.y = indNum;
-				vertices.push_back(vec4(p2, 1.0));
-				uvs.push_back(p2Uv);
-
-
-				// add properties for p6 to arrays
-				f2.z = indNum;
-
-				// add index to map and increment index
-				indexMap.insert({ ind2, indNum });
-				indNum++;
-			}
-
-			// Check for the existence of ind3 in our map
-			it = indexMap.find(ind3);
-			if (it != indexMap.end())
-			{
-				// calculate the index
-				int idx = it->second;
-
-				// set properties for p3
-				f1.z = idx;
-
-				// set properties for p4
-				f2.x = idx;
-			}
-			else {
-				// add properties to p3 to arrays
-				f1.z = indNum;
-				vertices.push_back(vec4(p3, 1.0));
-				uvs.push_back(p3Uv);
-
-				// add properties for p6 to arrays
-				f2.z = indNum;
-
-				// increment index
-				indexMap.insert({ ind3, indNum });
-				indNum++;
+	const int n = chunksPerSide();
+	const int side = C_DIM / WATER_STEP + 1; // vertices along a patch edge
+	for (int ci = 0; ci < n; ci++) {
+		for (int cj = 0; cj < n; cj++) {
+			for (int a = 0; a < side; a++) {
+				for (int b = 0; b < side; b++) {
+					int i = std::min(ci * C_DIM + a * WATER_STEP, dim - 1);
+					int j = std::min(cj * C_DIM + b * WATER_STEP, dim - 1);
+					vertices.push_back(vec4(slotPosition(i, j), 1.0));
+					uvs.push_back(vec2(j * 1.0, i * 1.0));
+				}
 			}
+		}
+	}
 
-			// Check for existence of ind4 in our map
-			it = indexMap.find(ind4);
-			if (it != indexMap.end())
-			{
-				// calculate the index
-				int idx = it->second;
+	// two faces per quad, wound the same way as the terrain
+	for (int a = 0; a < side - 1; a++) {
+		for (int b = 0; b < side - 1; b++) {
+			int v[] = { a*side + b, a*side + (b + 1), (a + 1)*side + b, (a + 1)*side + (b + 1) };
+			faces.push_back(uvec3(v[0], v[1], v[2]));
+			faces.push_back(uvec3(v[3], v[2], v[1]));
+		}
+	}
+}
 
-				// set properties for p1
-				f2.y = idx;
+// Water Chunks Method
+// @param
+// - level: the sea level
+// - chunks: receives the water chunks worth drawing
+// @description
+// - Keeps the chunks where the terrain dips below the water surface somewhere,
+//   stopping at the first sector that's low enough. Chunks that are dry land
+//   all the way across would only have their water hidden under the terrain
+//   so they are skipped. WATER_MARGIN leaves room for the wave crests.
+void Occulus::waterChunks(float level, vector<int> &chunks) {
+	TRACE_ZONE("water chunks");
+	chunks.clear();
+	const int n = chunksPerSide();
+	for (int ci = 0; ci < n; ci++) {
+		for (int cj = 0; cj < n; cj++) {
+			int i1 = std::min((ci + 1) * C_DIM, dim - 1);
+			int j1 = std::min((cj + 1) * C_DIM, dim - 1);
+			bool wet = false;
+			for (int i = ci * C_DIM; i <= i1 && !wet; i++) {
+				const Sector *row = &map[i * dim];
+				for (int j = cj * C_DIM; j <= j1; j++) {
+					if (row[j].position.y < level + WATER_MARGIN) {
+						wet = true;
+						break;
+					}
+				}
 			}
-			else {
-				// add properties to p1 to arrays and then increment our index
-				f2.y = indNum;
-				vertices.push_back(vec4(p4, 1.0));
-				uvs.push_back(p4Uv);
-				indexMap.insert({ ind4, indNum });
-				indNum++;
+			if (wet) {
+				chunks.push_back(ci * n + cj);
 			}
-
-			// push our faces
-			faces.push_back(f1);
-			int temp = f2.x;
-			f2.x = f2.y;
-			f2.y = temp;
-			faces.push_back(f2);
 		}
 	}
 }
 
-// Draw Method (Private)
+// Raycast Method
 // @param
-// - normals: The location of the normal map for the view area
-// - temps: The location of the temp map for the view area
-// - heights: The location of the height map for the view area
-// - faces: used to update normals, temps, and heights. 
+// - origin: where the ray starts, in world space (position plus slot offset)
+// - dir: the ray's direction, normalized here
+// - maxDist: how far along the ray to look
+// - hit: receives the first point where the ray meets the terrain
 // @description
-// - This is the method called by the update function; only updates global
-//   vector maps which have the potential to change between frames. Uses the faces
-//   map to help calculate the vertex normals for each point
-void Occulus::draw(vector<vec4> &normals, vector<float> &temps, vector<float> &heights, vector<uvec3> &faces) {
-	int indNum = 0;
-	int limit = O_DIM - 1;
-	int normSize = normals.size();
-
-	// Clear out normals array
-	for (int i = 0; i < normSize; i++) {
-		normals[i] = vec4(0.0f, 0.0f, 0.0f, 1.0);
-		temps[i] = 0.0;
-		heights[i] = 0.0;
+// - Walks the height pyramid, so open ground is crossed in strides that grow
+//   with the log of the distance rather than a cell at a time. Returns false
+//   if the ray leaves the view area or runs out of distance first.
+bool Occulus::raycast(vec3 origin, vec3 dir, float maxDist, vec3 &hit) {
+	TRACE_ZONE("raycast");
+	pyramid.flush();
+	float len = glm::length(dir);
+	float t;
+	if (len <= 0.0f || !pyramid.raycast(origin, dir / len, maxDist, t)) {
+		return false;
 	}
+	hit = origin + dir / len * t;
+	return true;
+}
 
-	for (int i = 0; i < faces.size(); i++) {
+// Region Bounds Method
+// @param
+// - lo: the world x, z corner of the region with the smallest coordinates
+// - hi: the opposite corner
+// @description
+// - Lowest and highest terrain height over a rectangle, for culling and
+//   placement. Empty if the rectangle misses the view area.
+HeightBounds Occulus::regionBounds(vec2 lo, vec2 hi) {
+	pyramid.flush();
+	return pyramid.regionBounds(lo, hi);
+}
 
-		// indicies mapping into our vectors
-		int i1 = faces[i].x;
-		int i2 = faces[i].y;
-		int i3 = faces[i].z;
+// Sample Height Method
+// @param
+// - x: world x position
+// - z: world z position
+// @description
+// - Terrain height at any world position, for gameplay. Safe to call from
+//   any thread while the view area moves. See sample.
+float Occulus::sampleHeight(float x, float z) const {
+	vec2 p(x, z);
+	float h;
+	sample(&p, 1, &h, nullptr);
+	return h;
+}
 
-		// indicies mapping into our grid
-		int ind1 = indexes[i1];
-		int ind2 = indexes[i2];
-		int ind3 = indexes[i3];
+// Sample Temperature Method
+// @param
+// - x: world x position
+// - z: world z position
+// @description
+// - Temperature at any world position, as sampleHeight.
+float Occulus::sampleTemp(float x, float z) const {
+	vec2 p(x, z);
+	float h, t;
+	sample(&p, 1, &h, &t);
+	return t;
+}
 
-		// get our points
-		vec3 p1 = map[ind1].position;
-		vec3 p2 = map[ind2].position;
-		vec3 p3 = map[ind3].position;
+// Sample Method
+// @param
+// - points: world x, z positions
+// - count: the number of points
+// - heights: receives the terrain height at each point
+// - temps: receives the temperature at each point, may be null
+// @description
+// - Batched sampleHeight and sampleTemp. Points inside the view area are
+//   bilinearly interpolated from the resident map in constant time without
+//   taking a lock; the rest are gathered and evaluated straight from the
+//   noise in one pass at full detail, with the settings read in the same
+//   lookup as the resident map.
+void Occulus::sample(const vec2 *points, int count, float *heights, float *temps) const {
+	NoiseShape shape;
+	if (resident.sample(points, count, heights, temps, &shape) == count) {
+		return;
+	}
+	Arena &scratch = Arena::local();
+	Arena::Scope scope(scratch);
+	int *missed = scratch.alloc<int>(count);
+	vec2 *far = scratch.alloc<vec2>(count);
+	int n = 0;
+	for (int k = 0; k < count; k++) {
+		if (heights[k] != heights[k]) { // NaN, outside the resident map
+			missed[n] = k;
+			far[n++] = points[k];
+		}
+	}
+	float *h = scratch.alloc<float>(n), *t = scratch.alloc<float>(n);
+	evaluate(shape, far, n, h, temps ? t : nullptr);
+	for (int k = 0; k < n; k++) {
+		heights[missed[k]] = h[k];
+		if (temps) {
+			temps[missed[k]] = t[k];
+		}
+	}
+}
 
-		// do a normal calculation
-		vec3 n1 = calcNormal(p1, p3, p2);
+// Evaluate Method
+// @param
+// - shape: the noise shape to build the heights with, as read from the
+//   resident map
+// - points: world x, z positions
+// - count: the number of points
+// - heights: receives the terrain height at each point
+// - temps: receives the temperature at each point, may be null
+// @description
+// - Height and temperature straight from the noise, the way combine builds
+//   them for a sector with every octave at full weight: the terrain itself,
+//   not the faded surface drawn far from the camera. One octave at a time
+//   over all the points, like combineMap. Reads no settings, so it is safe
+//   to call from any thread.
+void Occulus::evaluate(const NoiseShape &shape, const vec2 *points, int count, float *heights, float *temps) const {
+	const float pw = shape.heightPow;
+	Arena &scratch = Arena::local();
+	Arena::Scope scope(scratch);
+	float *nx = scratch.alloc<float>(count), *nz = scratch.alloc<float>(count);
+
+	for (int k = 0; k < count; k++) {
+		nx[k] = points[k].x / (O_DIM * 1.0) - 0.5;
+		nz[k] = points[k].y / (O_DIM * 1.0) - 0.5;
+		heights[k] = 0.0f;
+	}
+	for (int o = 0; o < SEA_OCTAVE; o++) {
+		for (int k = 0; k < count; k++) {
+			heights[k] += shape.amp[o] * open_simplex_noise2(ctx, nx[k] * shape.fx[o], nz[k] * shape.fz[o]);
+		}
+	}
+	for (int k = 0; k < count; k++) {
+		float hVal = heights[k] > FLAT_HEIGHT ? heights[k] * powf(heights[k], pw - 1.0f) : 0.0f;
+		hVal -= shape.amp[SEA_OCTAVE] * open_simplex_noise2(ctx, nx[k] * shape.fx[SEA_OCTAVE], nz[k] * shape.fz[SEA_OCTAVE]);
+		heights[k] = hVal * shape.maxH;
+	}
+	if (temps) {
+		for (int k = 0; k < count; k++) {
+			float baseTemp = temperature.sample(points[k].x, points[k].y);
+			temps[k] = clamp(baseTemp * 100.0 - heights[k] * 2.0, 0.0, 100.0);
+		}
+	}
+}
 
-		//update our normal array by adding the face normal
-		normals[i1] += vec4(n1, 1.0);
-		normals[i2] += vec4(n1, 1.0);
-		normals[i3] += vec4(n1, 1.0);
+// Chunk Size Method
+// @description
+// - Number of vertices in each terrain chunk.
+int Occulus::chunkSize() const {
+	return (C_DIM + 1) * (C_DIM + 1);
+}
 
-		// update temperature and height map
-		temps[i1] = map[ind1].temp;
-		temps[i2] = map[ind2].temp;
-		temps[i3] = map[ind3].temp;
-		heights[i1] = map[ind1].position.y;
-		heights[i2] = map[ind2].position.y;
-		heights[i3] = map[ind3].position.y;
-	}
+// Water Chunk Size Method
+// @description
+// - Number of vertices in each water chunk.
+int Occulus::waterChunkSize() const {
+	const int side = C_DIM / WATER_STEP + 1;
+	return side * side;
+}
 
-	// normalize vectors to accomplish smooth shading
-	for (int i = 0; i < normSize; i++) {
-		vec3 n = vec3(normals[i].x, normals[i].y, normals[i].z);
-		n = glm::normalize(n);
-		normals[i].x = n.x;
-		normals[i].y = n.y;
-		normals[i].z = n.z;
-	}
+// Chunks Per Side Method
+// @description
+// - Chunks needed along each side to cover the dim - 1 cells of the view area.
+int Occulus::chunksPerSide() const {
+	return (dim - 1 + C_DIM - 1) / C_DIM;
 }
 
-// Calculate Normal Method
+// Draw Method (Update)
 // @param
-// - p1: point one of our triangle
-// - p2: point two of our triangle
-// - p3: point three of our triangle
+// - normals: The location of the normal map for the view area
+// - temps: The location of the temp map for the view area
+// - heights: The location of the height map for the view area
 // @description
-// - takes in three points which consist a triangle and calculates
-//   the face normal for that triangle based on the position of
-//   each point.
-vec4 Occulus::calcNormal(vec3 p1, vec3 p2, vec3 p3) {
-	vec3 U = normalize(p2 - p1);
-	vec3 V = normalize(p3 - p1);
-	return vec4(cross(U, V), 1.0f);
+// - This is the method called by the update function; only updates global
+//   vector maps which have the potential to change between frames. Normals are
+//   copied from the sectors rather than rebuilt from the triangles, one job
+//   per row of chunks with the rows nearest the camera first.
+void Occulus::draw(vector<vec4> &normals, vector<float> &temps, vector<float> &heights) {
+	TRACE_ZONE("draw attributes");
+	const int normSize = normals.size();
+	const int n = chunksPerSide();
+	const int band = n * chunkSize(); // vertices in a row of chunks
+	JobGroup rows;
+
+	for (int ci = 0; ci < n && ci * band < normSize; ci++) {
+		jobs.submit(rows, jobPriority(ci * C_DIM, C_DIM, 0, dim), [&, ci] {
+			TRACE_ZONE("pack chunk row");
+			int end = std::min((ci + 1) * band, normSize);
+			for (int i = ci * band; i < end; i++) {
+				const Sector &sec = map[indexes[i]];
+				normals[i] = vec4(sec.normal, 1.0);
+				temps[i] = sec.temp;
+				heights[i] = sec.position.y;
+			}
+		});
+	}
+	jobs.wait(rows);
 }
 
 // Calculate Flags Method()
@@ -628,106 +1509,101 @@ int Occulus::calcFlags() {
 	return f;
 }
 
-// Run Generate Row Method
-// @description
-// - Thread function used to generate a new row using the map noise function.
-void Occulus::runGenRow() {
-	rowThreadFinished.lock();
-
-	int flags = calcFlags(); // get our bit vector representing movement
-	int zDir = flags & 3; // pull out the flags for the z-direction
-
-	// Only run calculations if we're moving in this direction
-	if (zDir) {
-		int replace[] = { -1, 0, O_DIM - 1 }; // array to hold which row to replace
-		vector<tuple<float, float>> row; // create a vector to hold the noise values for our new row
-		// one final check to make sure nothing went wrong
-		if (replace[zDir] >= 0) {
-			genRow(zDir, row);
-
-			copyFinished.lock();
-			// Copy our values into our map
-			for (int i = 0; i < O_DIM; i++) {
-				int idx = replace[zDir] * O_DIM + i;
-				map[idx].position.y = get<0>(row[i]);
-				map[idx].temp = get<1>(row[i]);
-			}
-
-			copyFinished.unlock();
-		}
-	}
-
-	rowThreadFinished.unlock();
-}
-
-// Run Generate Column Method
-// @description
-// - Thread function used to generate a new column using the map noise function.
-void Occulus::runGenCol() {
-	colThreadFinished.lock();
-	int flags = calcFlags(); // get our bit vector representing movement
-	int xDir = (flags >> 2) & 3; // pull out the flags for the z-direction
-
-						  // Only run calculations if we're moving in this direction
-	if (xDir) {
-		int replace[] = { -1, 0, O_DIM - 1 }; // array to hold which column to replace
-		vector<tuple<float, float>> col; // create a vector to hold the noise values for our new column
-		// one final check to make sure nothing went wrong
-		if (replace[xDir] >= 0) {
-			genCol(xDir, col);
-
-			copyFinished.lock();
-			// Copy our values into our map
-			for (int i = 0; i < O_DIM; i++) {
-				int idx = i * O_DIM + replace[xDir];
-				map[idx].position.y = get<0>(col[i]);
-				map[idx].temp = get<1>(col[i]);
-			}
-			copyFinished.unlock();
-		}
-	}
-
-	// mark column generation finished
-	colThreadFinished.unlock();
-}
-
 // Generate Row Function
 // @param
+// - group: the group the row's jobs go in
 // - flags : a bit vector denoting which direction on the z axis we're moving
 // - row : a reference to a location to store our generated noise values
+// - rowTiles : a location to store the raw noise of the new row
 // @description
-// - generates a new row of values using the mapNoise method and then stores
-//   them in the passed vector
-void Occulus::genRow(int flags, vector<tuple<float, float>> &row) {
-	int r[] = { -1, 0, O_DIM - 1 }; // values to determine which row to generate noise for
+// - Queues the new row as jobs of C_DIM sectors each, nearest the camera
+//   first, which fill in the passed vectors using the mapNoise method. Wait
+//   for the group before reading them. A prefetched line saves the climate
+//   and the noise, see takeLine.
+void Occulus::genRow(JobGroup &group, int flags, vector<Sector> &row, OctaveTiles &rowTiles) {
+	int r[] = { -1, 0, dim - 1 }; // values to determine which row to generate noise for
 	// Check to make sure we're actually generating noise
 	if (r[flags] >= 0) {
-		// generate a new column of noise
-		for (int i = 0; i < O_DIM; i++) {
-			int idx = r[flags] * O_DIM + i;
-			tuple<float, float> ht = mapNoise(map[idx].position);
-			row.push_back(ht);
+		const int i = r[flags];
+		for (int j = 0; j < dim; j++) {
+			row.push_back(Sector());
+			row.back().init(slotPosition(i, j));
+		}
+		rowTiles.resize(dim);
+		bool taken = takeLine(0, i, row, rowTiles);
+		for (int j0 = 0; j0 < dim; j0 += C_DIM) {
+			int cols = std::min(C_DIM, dim - j0);
+			jobs.submit(group, jobPriority(i, 1, j0, cols), [this, &row, &rowTiles, i, j0, cols, taken] {
+				TRACE_ZONE("row segment");
+				if (!taken) {
+					mapClimate(i, 1, j0, cols, row.data() + j0);
+				}
+				for (int j = j0; j < j0 + cols; j++) {
+					mapNoise(row[j], rowTiles, j, lodTarget[i * dim + j]);
+					combine(row[j], rowTiles, j);
+				}
+			});
 		}
 	}
 }
 
 // Generate Column Function
 // @param
-// - flags : a bit vector denoting which direction on the z axis we're moving
+// - group: the group the column's jobs go in
+// - flags : a bit vector denoting which direction on the x axis we're moving
 // - col : a reference to a location to store our generated noise values
+// - colTiles : a location to store the raw noise of the new column
 // @description
-// - generates a new column of values using the mapNoise method and then stores
-//   them in the passed vector
-void Occulus::genCol(int flags, vector<tuple<float, float>> &col) {
-	int c[] = { -1, 0, O_DIM - 1 }; // values to determine which row to generate noise for
+// - Queues the new column as jobs of C_DIM sectors each, nearest the camera
+//   first, which fill in the passed vectors using the mapNoise method. Wait
+//   for the group before reading them. A prefetched line saves the climate
+//   and the noise, see takeLine.
+void Occulus::genCol(JobGroup &group, int flags, vector<Sector> &col, OctaveTiles &colTiles) {
+	int c[] = { -1, 0, dim - 1 }; // values to determine which column to generate noise for
 
 	// Check to make sure we're actually generating noise
 	if (c[flags] >= 0) {
-		// generate a new column of noise
-		for (int i = 0; i < O_DIM; i++) {
-			int idx = i * O_DIM + c[flags];
-			tuple<float, float> ht = mapNoise(map[idx].position);
-			col.push_back(ht);
+		const int j = c[flags];
+		for (int i = 0; i < dim; i++) {
+			col.push_back(Sector());
+			col.back().init(slotPosition(i, j));
+		}
+		colTiles.resize(dim);
+		bool taken = takeLine(1, j, col, colTiles);
+		for (int i0 = 0; i0 < dim; i0 += C_DIM) {
+			int rows = std::min(C_DIM, dim - i0);
+			jobs.submit(group, jobPriority(i0, rows, j, 1), [this, &col, &colTiles, j, i0, rows, taken] {
+				TRACE_ZONE("column segment");
+				if (!taken) {
+					mapClimate(i0, rows, j, 1, col.data() + i0);
+				}
+				for (int i = i0; i < i0 + rows; i++) {
+					mapNoise(col[i], colTiles, i, lodTarget[i * dim + j]);
+					combine(col[i], colTiles, i);
+				}
+			});
 		}
 	}
-}
\ No newline at end of file
+}
+
+// Fixed Occulus Shift Method
+// @description
+// - Compile-time sized version of Occulus::shift.
+template <int Dim>
+void FixedOcculus<Dim>::shift(int zDir, int xDir) {
+	shiftMap(FixedGrid<Dim>(), zDir, xDir);
+}
+
+// Fixed Occulus Refresh Method
+// @description
+// - Compile-time sized version of Occulus::refresh.
+template <int Dim>
+void FixedOcculus<Dim>::refresh() {
+	refreshMap(FixedGrid<Dim>());
+}
+
+// Common view sizes, see Occulus::create
+template class FixedOcculus<C_DIM * 10>;
+template class FixedOcculus<C_DIM * 20>;
+template class FixedOcculus<C_DIM * 30>;
+template class FixedOcculus<C_DIM * 40>;
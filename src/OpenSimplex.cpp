@@ -352,6 +352,143 @@ double open_simplex_noise2(struct osn_context *ctx, double x, double y)
 	return value / NORM_CONSTANT_2D;
 }
 
+/*
+* Adds the contribution of one 2D lattice vertex to value and to the
+* gradient (ddx, ddy). The falloff is attn^4 with attn = 2 - dx^2 - dy^2,
+* so d/dx = attn^4 * gx - 8 * attn^3 * dx * (g . d).
+*/
+static INLINE void contribute2_deriv(struct osn_context *ctx, int xsb, int ysb, double dx, double dy,
+	double *value, double *ddx, double *ddy)
+{
+	int16_t *perm = ctx->perm;
+	int index;
+	double attn, attn2, attn3, attn4, ext, gx, gy;
+
+	attn = 2 - dx * dx - dy * dy;
+	if (attn <= 0)
+		return;
+	index = perm[(perm[xsb & 0xFF] + ysb) & 0xFF] & 0x0E;
+	gx = gradients2D[index];
+	gy = gradients2D[index + 1];
+	ext = gx * dx + gy * dy;
+	attn2 = attn * attn;
+	attn3 = attn2 * attn;
+	attn4 = attn2 * attn2;
+	*value += attn4 * ext;
+	*ddx += attn4 * gx - 8 * attn3 * dx * ext;
+	*ddy += attn4 * gy - 8 * attn3 * dy * ext;
+}
+
+/*
+* 2D OpenSimplex (Simplectic) Noise with analytic derivatives.
+* Returns the same value as open_simplex_noise2 and writes the partial
+* derivatives with respect to x and y to *dx and *dy.
+*/
+double open_simplex_noise2_deriv(struct osn_context *ctx, double x, double y, double *dx, double *dy)
+{
+
+	/* Place input coordinates onto grid. */
+	double stretchOffset = (x + y) * STRETCH_CONSTANT_2D;
+	double xs = x + stretchOffset;
+	double ys = y + stretchOffset;
+
+	/* Floor to get grid coordinates of rhombus (stretched square) super-cell origin. */
+	int xsb = fastFloor(xs);
+	int ysb = fastFloor(ys);
+
+	/* Skew out to get actual coordinates of rhombus origin. We'll need these later. */
+	double squishOffset = (xsb + ysb) * SQUISH_CONSTANT_2D;
+	double xb = xsb + squishOffset;
+	double yb = ysb + squishOffset;
+
+	/* Compute grid coordinates relative to rhombus origin. */
+	double xins = xs - xsb;
+	double yins = ys - ysb;
+
+	/* Sum those together to get a value that determines which region we're in. */
+	double inSum = xins + yins;
+
+	/* Positions relative to origin point. */
+	double dx0 = x - xb;
+	double dy0 = y - yb;
+
+	/* We'll be defining these inside the next block and using them afterwards. */
+	double dx_ext, dy_ext;
+	int xsv_ext, ysv_ext;
+	double zins;
+
+	double value = 0;
+	double ddx = 0;
+	double ddy = 0;
+
+	/* Contribution (1,0) */
+	contribute2_deriv(ctx, xsb + 1, ysb + 0, dx0 - 1 - SQUISH_CONSTANT_2D, dy0 - 0 - SQUISH_CONSTANT_2D, &value, &ddx, &ddy);
+
+	/* Contribution (0,1) */
+	contribute2_deriv(ctx, xsb + 0, ysb + 1, dx0 - 0 - SQUISH_CONSTANT_2D, dy0 - 1 - SQUISH_CONSTANT_2D, &value, &ddx, &ddy);
+
+	if (inSum <= 1) { /* We're inside the triangle (2-Simplex) at (0,0) */
+		zins = 1 - inSum;
+		if (zins > xins || zins > yins) { /* (0,0) is one of the closest two triangular vertices */
+			if (xins > yins) {
+				xsv_ext = xsb + 1;
+				ysv_ext = ysb - 1;
+				dx_ext = dx0 - 1;
+				dy_ext = dy0 + 1;
+			}
+			else {
+				xsv_ext = xsb - 1;
+				ysv_ext = ysb + 1;
+				dx_ext = dx0 + 1;
+				dy_ext = dy0 - 1;
+			}
+		}
+		else { /* (1,0) and (0,1) are the closest two vertices. */
+			xsv_ext = xsb + 1;
+			ysv_ext = ysb + 1;
+			dx_ext = dx0 - 1 - 2 * SQUISH_CONSTANT_2D;
+			dy_ext = dy0 - 1 - 2 * SQUISH_CONSTANT_2D;
+		}
+	}
+	else { /* We're inside the triangle (2-Simplex) at (1,1) */
+		zins = 2 - inSum;
+		if (zins < xins || zins < yins) { /* (0,0) is one of the closest two triangular vertices */
+			if (xins > yins) {
+				xsv_ext = xsb + 2;
+				ysv_ext = ysb + 0;
+				dx_ext = dx0 - 2 - 2 * SQUISH_CONSTANT_2D;
+				dy_ext = dy0 + 0 - 2 * SQUISH_CONSTANT_2D;
+			}
+			else {
+				xsv_ext = xsb + 0;
+				ysv_ext = ysb + 2;
+				dx_ext = dx0 + 0 - 2 * SQUISH_CONSTANT_2D;
+				dy_ext = dy0 - 2 - 2 * SQUISH_CONSTANT_2D;
+			}
+		}
+		else { /* (1,0) and (0,1) are the closest two vertices. */
+			dx_ext = dx0;
+			dy_ext = dy0;
+			xsv_ext = xsb;
+			ysv_ext = ysb;
+		}
+		xsb += 1;
+		ysb += 1;
+		dx0 = dx0 - 1 - 2 * SQUISH_CONSTANT_2D;
+		dy0 = dy0 - 1 - 2 * SQUISH_CONSTANT_2D;
+	}
+
+	/* Contribution (0,0) or (1,1) */
+	contribute2_deriv(ctx, xsb, ysb, dx0, dy0, &value, &ddx, &ddy);
+
+	/* Extra Vertex */
+	contribute2_deriv(ctx, xsv_ext, ysv_ext, dx_ext, dy_ext, &value, &ddx, &ddy);
+
+	*dx = ddx / NORM_CONSTANT_2D;
+	*dy = ddy / NORM_CONSTANT_2D;
+	return value / NORM_CONSTANT_2D;
+}
+
 /*
 * 3D OpenSimplex (Simplectic) Noise
 */
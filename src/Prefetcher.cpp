@@ -0,0 +1,164 @@
+#include "Prefetcher.h"
+#include "Trace.h"
+#include <utility>
+using std::vector;
+
+// Wanted Function
+// @description
+// - Whether a line already held covers the sectors a wanted line is for,
+//   which is the wanted line less its margins.
+static bool wanted(const PrefetchLine &have, const PrefetchLine &want) {
+	return have.covers(want.axis, want.line, want.start + PREFETCH_MARGIN, want.length - 2 * PREFETCH_MARGIN);
+}
+
+// Constructor
+// @param
+// - jobs: the pool the lines are baked on
+// - bake: generates a line in place from its axis, position and frequencies
+Prefetcher::Prefetcher(JobSystem &jobs, Bake bake) :
+	jobs(jobs),
+	bake(bake)
+{
+	held.reserve(PREFETCH_LINES);
+	dropped.reserve(PREFETCH_LINES);
+	spare.reserve(PREFETCH_LINES);
+	for (int l = 0; l < PREFETCH_LINES; l++) {
+		spare.push_back(std::unique_ptr<Pending>(new Pending()));
+	}
+}
+
+// Destructor
+// @description
+// - Cancels every line and waits for the ones being baked.
+Prefetcher::~Prefetcher() {
+	std::lock_guard<std::mutex> guard(lock);
+	while (held.size()) {
+		drop(held.size() - 1);
+	}
+	for (size_t d = 0; d < dropped.size(); d++) {
+		jobs.wait(dropped[d]->job);
+	}
+}
+
+// Want Method
+// @param
+// - lines: every line that should be generated ahead, nearest first, with
+//   their data left empty
+// @description
+// - Replaces the set of lines to prefetch. Lines that are no longer wanted
+//   are cancelled or freed; wanted lines that are not held are queued as
+//   background jobs, the nearest as the most urgent.
+void Prefetcher::want(const vector<PrefetchLine> &lines) {
+	std::lock_guard<std::mutex> guard(lock);
+	for (size_t h = held.size(); h-- > 0;) {
+		bool keep = false;
+		for (size_t w = 0; w < lines.size() && !keep; w++) {
+			keep = wanted(held[h]->line, lines[w]);
+		}
+		if (!keep) {
+			drop(h);
+		}
+	}
+	reap();
+
+	for (size_t w = 0; w < lines.size(); w++) {
+		bool have = false;
+		for (size_t h = 0; h < held.size() && !have; h++) {
+			have = wanted(held[h]->line, lines[w]);
+		}
+		if (have || !spare.size()) { // every line is held or still being dropped
+			continue;
+		}
+		Pending *p = spare.back().get();
+		p->job.reuse();
+		p->line = lines[w]; // the wanted line has no data, so this keeps the spare's buffers
+		held.push_back(std::move(spare.back()));
+		spare.pop_back();
+		jobs.submit(p->job, JOB_BACKGROUND + w, [this, p] {
+			TRACE_ZONE("prefetch line");
+			bake(p->line);
+		});
+	}
+}
+
+// Reserve Method
+// @param
+// - length: sectors in the longest line that will be wanted
+// @description
+// - Sizes the buffers of every spare line up front, so baking never grows
+//   them. Call once the view size is known, before anything is wanted.
+void Prefetcher::reserve(int length) {
+	std::lock_guard<std::mutex> guard(lock);
+	for (size_t s = 0; s < spare.size(); s++) {
+		sizeLine(spare[s]->line, length);
+	}
+}
+
+// Size Line Function
+// @param
+// - line: the line whose buffers to size
+// - length: the number of sectors they should hold
+void Prefetcher::sizeLine(PrefetchLine &line, int length) {
+	line.baseTemp.resize(length);
+	line.tiles.resize(length);
+}
+
+// Take Method
+// @param
+// - axis: 0 for a row, 1 for a column
+// - line: grid z of the row or grid x of the column
+// - start: grid coordinate of the first sector needed along the line
+// - length: the number of sectors needed
+// - out: receives the line, which is no longer held afterwards
+// @description
+// - Hands over a baked line covering the sectors, if there is one, by
+//   swapping it with out; whatever out held goes back in the pool. Returns
+//   false if the caller has to generate them itself.
+bool Prefetcher::take(int axis, int line, int start, int length, PrefetchLine &out) {
+	std::lock_guard<std::mutex> guard(lock);
+	for (size_t h = 0; h < held.size(); h++) {
+		if (held[h]->job.done() && held[h]->line.covers(axis, line, start, length)) {
+			std::swap(out, held[h]->line);
+			spare.push_back(std::move(held[h]));
+			held.erase(held.begin() + h);
+			return true;
+		}
+	}
+	return false;
+}
+
+// Invalidate Method
+// @description
+// - Drops every line, for when the octave frequencies change.
+void Prefetcher::invalidate() {
+	std::lock_guard<std::mutex> guard(lock);
+	while (held.size()) {
+		drop(held.size() - 1);
+	}
+	reap();
+}
+
+// Drop Method
+// @param
+// - idx: the line to drop
+// @description
+// - Cancels a line's job. The line is kept, with its memory counted against
+//   the limit, until the job is known to be over.
+void Prefetcher::drop(size_t idx) {
+	held[idx]->job.cancel();
+	dropped.push_back(std::move(held[idx]));
+	held.erase(held.begin() + idx);
+}
+
+// Reap Method
+// @description
+// - Puts dropped lines whose job has finished or been skipped back in the
+//   pool.
+void Prefetcher::reap() {
+	for (size_t d = dropped.size(); d-- > 0;) {
+		if (dropped[d]->job.done()) {
+			spare.push_back(std::move(dropped[d]));
+			dropped.erase(dropped.begin() + d);
+		}
+	}
+}
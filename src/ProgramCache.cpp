@@ -0,0 +1,132 @@
+#include "ProgramCache.h"
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#ifdef _WIN32
+#include <direct.h>
+#define makeDir(p) _mkdir(p)
+#else
+#include <sys/stat.h>
+#define makeDir(p) mkdir(p, 0755)
+#endif
+
+#define CACHE_MAGIC 0x4250574Fu // "OWPB", first word of every cache file
+
+// Hash Function
+// @description
+// - 64-bit FNV-1a, folded over several strings in turn.
+static uint64_t hash(uint64_t h, const char *s) {
+	for (; *s; s++) {
+		h = (h ^ (unsigned char)*s) * 0x100000001B3ull;
+	}
+	return (h ^ 0xFF) * 0x100000001B3ull; // terminator so "ab"+"c" != "a"+"bc"
+}
+
+// Constructor
+// @param
+// - dir: directory the binaries are kept in, created if it doesn't exist
+// @description
+// - Caching is switched off when the driver has the extension but offers no
+//   binary formats, which some drivers do to opt out.
+ProgramCache::ProgramCache(const std::string &dir) :
+	dir(dir),
+	supported(false)
+{
+	if (GLEW_ARB_get_program_binary) {
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		supported = formats > 0;
+	}
+	if (supported) {
+		makeDir(dir.c_str());
+	}
+}
+
+// Load Method
+// @param
+// - program: a freshly created program object
+// - sources: every shader source string that goes into the program
+// - count: the number of source strings
+// @description
+// - Loads the program from its cached binary. Returns true if the program is
+//   now linked. On a miss the program is left unlinked and marked retrievable,
+//   ready for the caller to attach its shaders, link and then call store.
+bool ProgramCache::load(GLuint program, const char *const *sources, int count) {
+	if (!supported) {
+		return false;
+	}
+	glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	FILE *f = fopen(path(sources, count).c_str(), "rb");
+	if (!f) {
+		return false;
+	}
+	uint32_t header[3] = { 0, 0, 0 }; // magic, format, length
+	std::vector<char> binary;
+	if (fread(header, sizeof(uint32_t), 3, f) == 3 && header[0] == CACHE_MAGIC) {
+		binary.resize(header[2]);
+		if (binary.empty() || fread(&binary[0], 1, binary.size(), f) != binary.size()) {
+			binary.clear();
+		}
+	}
+	fclose(f);
+	if (binary.empty()) {
+		return false;
+	}
+
+	// a format the driver no longer offers is a GL error, not just a failed load
+	GLint numFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+	std::vector<GLint> formats(numFormats);
+	glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, &formats[0]);
+	if (std::find(formats.begin(), formats.end(), (GLint)header[1]) == formats.end()) {
+		return false;
+	}
+	glProgramBinary(program, header[1], &binary[0], binary.size());
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	return status == GL_TRUE;
+}
+
+// Store Method
+// @param
+// - program: a program that load missed on and that has since been linked
+// - sources: the same source strings given to load
+// - count: the number of source strings
+void ProgramCache::store(GLuint program, const char *const *sources, int count) {
+	if (!supported) {
+		return;
+	}
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return;
+	}
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, &binary[0]);
+	FILE *f = fopen(path(sources, count).c_str(), "wb");
+	if (!f) {
+		return;
+	}
+	uint32_t header[3] = { CACHE_MAGIC, format, (uint32_t)length };
+	fwrite(header, sizeof(uint32_t), 3, f);
+	fwrite(&binary[0], 1, length, f);
+	fclose(f);
+}
+
+// Path Method
+// @description
+// - Cache file for a set of sources on the current driver.
+std::string ProgramCache::path(const char *const *sources, int count) const {
+	uint64_t h = 0xCBF29CE484222325ull;
+	h = hash(h, (const char *)glGetString(GL_VENDOR));
+	h = hash(h, (const char *)glGetString(GL_RENDERER));
+	h = hash(h, (const char *)glGetString(GL_VERSION));
+	for (int i = 0; i < count; i++) {
+		h = hash(h, sources[i]);
+	}
+	char name[32];
+	snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)h);
+	return dir + name;
+}
@@ -0,0 +1,181 @@
+#include "ResidentMap.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <thread>
+#include <type_traits>
+using glm::vec2;
+
+static const std::memory_order relaxed = std::memory_order_relaxed;
+
+static_assert(std::is_trivially_copyable<NoiseShape>::value &&
+	sizeof(NoiseShape) % sizeof(float) == 0, "the noise shape is published as floats");
+
+// Constructor
+// @description
+// - An empty map; every sample misses until resize and the first write.
+ResidentMap::ResidentMap() :
+	dim(0),
+	side(1),
+	spacing(1.0f),
+	sequence(0),
+	originX(0),
+	originZ(0),
+	offsetX(0.0f),
+	offsetZ(0.0f)
+{
+	for (int k = 0; k < SHAPE_VALUES; k++) {
+		shapeValues[k].store(0.0f, relaxed);
+	}
+}
+
+// Resize Method
+// @param
+// - dim: sectors along each side of the view area
+// - spacing: world distance between sectors
+// @description
+// - Sizes the map for a view area. Not safe against readers; only call it
+//   before the map is shared.
+void ResidentMap::resize(int dim, float spacing) {
+	this->dim = dim;
+	this->spacing = spacing;
+	side = 1;
+	while (side < dim) {
+		side <<= 1;
+	}
+	slots.reset(new Slot[side * side]);
+	for (int idx = 0; idx < side * side; idx++) {
+		slots[idx].height.store(0.0f, relaxed);
+		slots[idx].temp.store(0.0f, relaxed);
+	}
+}
+
+// Begin Write Method
+// @description
+// - Starts a batch of place and set calls. Readers that overlap the batch
+//   retry once it ends. Only the generator thread writes.
+void ResidentMap::beginWrite() {
+	sequence.store(sequence.load(relaxed) + 1, relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+// End Write Method
+// @description
+// - Publishes the batch.
+void ResidentMap::endWrite() {
+	sequence.store(sequence.load(relaxed) + 1, std::memory_order_release);
+}
+
+// Place Method
+// @param
+// - gx, gz: grid coordinates of the view area's first sector
+// - offset: world position of grid coordinate 0, 0
+// @description
+// - Moves the window. Sectors that came into view must be set in the same
+//   batch.
+void ResidentMap::place(int gx, int gz, vec2 offset) {
+	originX.store(gx, relaxed);
+	originZ.store(gz, relaxed);
+	offsetX.store(offset.x, relaxed);
+	offsetZ.store(offset.y, relaxed);
+}
+
+// Set Method
+// @param
+// - gx, gz: grid coordinates of the sector
+// - height: the sector's height
+// - temp: the sector's temperature
+void ResidentMap::set(int gx, int gz, float height, float temp) {
+	Slot &s = slots[(gz & (side - 1)) * side + (gx & (side - 1))];
+	s.height.store(height, relaxed);
+	s.temp.store(temp, relaxed);
+}
+
+// Set Shape Method
+// @param
+// - shape: the noise shape the sectors being set were built with
+void ResidentMap::setShape(const NoiseShape &shape) {
+	float values[SHAPE_VALUES];
+	memcpy(values, &shape, sizeof(values));
+	for (int k = 0; k < SHAPE_VALUES; k++) {
+		shapeValues[k].store(values[k], relaxed);
+	}
+}
+
+// Sample Method
+// @param
+// - points: world x, z positions
+// - count: the number of points
+// - heights: receives each point's height, NaN where the point is outside
+//   the window
+// - temps: receives each point's temperature, may be null
+// - shape: receives the noise shape, may be null
+// @description
+// - Bilinearly interpolates the four sectors around each point. The whole
+//   batch is read under one sequence number, so it is consistent with a
+//   single state of the window. Returns the number of points found.
+int ResidentMap::sample(const vec2 *points, int count, float *heights, float *temps,
+	NoiseShape *shape) const {
+	while (true) {
+		unsigned int s = sequence.load(std::memory_order_acquire);
+		if (s & 1) {
+			std::this_thread::yield();
+			continue;
+		}
+		vec2 offset(offsetX.load(relaxed), offsetZ.load(relaxed));
+		glm::ivec2 origin(originX.load(relaxed), originZ.load(relaxed));
+		int found = 0;
+		for (int k = 0; k < count; k++) {
+			float t;
+			if (lookup(points[k], offset, origin, heights[k], t)) {
+				found++;
+			} else {
+				heights[k] = t = std::numeric_limits<float>::quiet_NaN();
+			}
+			if (temps) {
+				temps[k] = t;
+			}
+		}
+		if (shape) {
+			float values[SHAPE_VALUES];
+			for (int k = 0; k < SHAPE_VALUES; k++) {
+				values[k] = shapeValues[k].load(relaxed);
+			}
+			memcpy(shape, values, sizeof(values));
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (sequence.load(relaxed) == s) {
+			return found;
+		}
+	}
+}
+
+// Lookup Method
+// @description
+// - One point of sample, without the sequence check.
+bool ResidentMap::lookup(vec2 p, vec2 offset, glm::ivec2 origin, float &height, float &temp) const {
+	// grid position relative to the first sector, inside [0, dim - 1] on both axes
+	float fx = (p.x - offset.x) / spacing - origin.x;
+	float fz = (p.y - offset.y) / spacing - origin.y;
+	if (!(fx >= 0.0f && fx <= dim - 1 && fz >= 0.0f && fz <= dim - 1)) {
+		return false;
+	}
+	float cx = std::min(floorf(fx), dim - 2.0f); // the far edge uses the last cell
+	float cz = std::min(floorf(fz), dim - 2.0f);
+	float tx = fx - cx;
+	float tz = fz - cz;
+	int gx = (int)cx + origin.x;
+	int gz = (int)cz + origin.y;
+	int x0 = gx & (side - 1), x1 = (gx + 1) & (side - 1);
+	int z0 = (gz & (side - 1)) * side, z1 = ((gz + 1) & (side - 1)) * side;
+	const Slot &a = slots[z0 + x0], &b = slots[z0 + x1], &c = slots[z1 + x0], &d = slots[z1 + x1];
+
+	float top = a.height.load(relaxed) + (b.height.load(relaxed) - a.height.load(relaxed)) * tx;
+	float bottom = c.height.load(relaxed) + (d.height.load(relaxed) - c.height.load(relaxed)) * tx;
+	height = top + (bottom - top) * tz;
+	top = a.temp.load(relaxed) + (b.temp.load(relaxed) - a.temp.load(relaxed)) * tx;
+	bottom = c.temp.load(relaxed) + (d.temp.load(relaxed) - c.temp.load(relaxed)) * tx;
+	temp = top + (bottom - top) * tz;
+	return true;
+}
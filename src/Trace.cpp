@@ -0,0 +1,161 @@
+#include "Trace.h"
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+// Trace Event
+// @description
+// - One finished zone, times in nanoseconds since the trace epoch.
+struct TraceEvent {
+	const char *name;
+	int64_t start;
+	int64_t end;
+};
+
+// Trace Ring
+// @description
+// - A thread's events. Only the owning thread writes events and head; head
+//   counts every event ever recorded, so the live ones are the last
+//   TRACE_RING before it.
+struct TraceRing {
+	TraceEvent events[TRACE_RING];
+	std::atomic<uint64_t> head;
+	int id;
+	std::string name;
+};
+
+std::atomic<bool> Trace::on(false);
+static std::mutex registry; // guards rings, freeRings and the ring names
+static std::vector<TraceRing *> rings;
+static std::vector<TraceRing *> freeRings;
+static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+// Thread Ring
+// @description
+// - Owns the calling thread's ring, taking a free one (or making a new one)
+//   the first time it's needed and handing it back when the thread exits.
+//   A named thread prefers a free ring that had the same name, so each kind
+//   of worker keeps showing up on one line of the trace.
+struct ThreadRing {
+	TraceRing *ring = nullptr;
+	TraceRing *get(const char *name = "") {
+		if (!ring) {
+			std::lock_guard<std::mutex> lock(registry);
+			size_t i = 0;
+			while (i < freeRings.size() && freeRings[i]->name != name) {
+				i++;
+			}
+			if (i == freeRings.size() && freeRings.size()) {
+				i = 0; // none with this name, any free ring will do
+			}
+			if (i < freeRings.size()) {
+				ring = freeRings[i];
+				freeRings.erase(freeRings.begin() + i);
+			}
+			else {
+				ring = new TraceRing();
+				ring->head.store(0);
+				ring->id = rings.size() + 1;
+				rings.push_back(ring);
+			}
+		}
+		return ring;
+	}
+	~ThreadRing() {
+		if (ring) {
+			std::lock_guard<std::mutex> lock(registry);
+			freeRings.push_back(ring);
+		}
+	}
+};
+static thread_local ThreadRing threadRing;
+
+// Enable Method
+// @param
+// - state: whether zones should be recorded
+void Trace::enable(bool state) {
+	on.store(state, std::memory_order_relaxed);
+}
+
+// Name Thread Method
+// @param
+// - name: the name to show for the calling thread's events
+void Trace::nameThread(const char *name) {
+	TraceRing *ring = threadRing.get(name);
+	std::lock_guard<std::mutex> lock(registry);
+	ring->name = name;
+}
+
+// Clear Method
+// @description
+// - Drops every recorded event. Meant to be called while tracing is off.
+void Trace::clear() {
+	std::lock_guard<std::mutex> lock(registry);
+	for (size_t r = 0; r < rings.size(); r++) {
+		rings[r]->head.store(0, std::memory_order_release);
+	}
+}
+
+// Now Method
+// @description
+// - Nanoseconds since the trace epoch.
+int64_t Trace::now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+// Record Method
+// @param
+// - name: the zone name, must outlive the trace (a string literal)
+// - start: when the zone started
+// - end: when the zone ended
+// @description
+// - Adds a finished zone to the calling thread's ring. Lock free apart from
+//   the thread's very first event.
+void Trace::record(const char *name, int64_t start, int64_t end) {
+	TraceRing *ring = threadRing.get();
+	uint64_t h = ring->head.load(std::memory_order_relaxed);
+	TraceEvent &e = ring->events[h % TRACE_RING];
+	e.name = name;
+	e.start = start;
+	e.end = end;
+	ring->head.store(h + 1, std::memory_order_release);
+}
+
+// Write Method
+// @param
+// - file: the file to write
+// @description
+// - Exports the events of every thread as Chrome trace-event JSON, one
+//   complete ("X") event per zone with times in microseconds. Events recorded
+//   while exporting may come out torn, so disable tracing first for a clean
+//   capture.
+bool Trace::write(const std::string &file) {
+	FILE *f = fopen(file.c_str(), "w");
+	if (!f) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(registry);
+	bool first = true;
+	fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+	for (size_t r = 0; r < rings.size(); r++) {
+		const TraceRing *ring = rings[r];
+		if (!ring->name.empty()) {
+			fprintf(f, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+				first ? "" : ",", ring->id, ring->name.c_str());
+			first = false;
+		}
+		uint64_t head = ring->head.load(std::memory_order_acquire);
+		uint64_t begin = head > TRACE_RING ? head - TRACE_RING : 0;
+		for (uint64_t i = begin; i < head; i++) {
+			const TraceEvent &e = ring->events[i % TRACE_RING];
+			fprintf(f, "%s\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+				first ? "" : ",", e.name, ring->id, e.start / 1000.0, (e.end - e.start) / 1000.0);
+			first = false;
+		}
+	}
+	fprintf(f, "\n]}\n");
+	fclose(f);
+	return true;
+}
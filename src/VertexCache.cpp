@@ -0,0 +1,165 @@
+#include "VertexCache.h"
+#include <cmath>
+#include <algorithm>
+using std::vector;
+using glm::uvec3;
+
+// Vertex Score Function
+// @param
+// - cachePos: the vertex's position in the simulated LRU cache, -1 if not in it
+// - valence: the number of triangles still to be emitted that use the vertex
+// @description
+// - Forsyth's vertex score: vertices of the triangle just emitted score a
+//   flat 0.75 (so the next triangle doesn't just reuse the same three), the
+//   rest of the cache decays with position, and vertices with few triangles
+//   left get a boost so they are finished off instead of left stranded.
+static float vertexScore(int cachePos, int valence) {
+	if (valence == 0) {
+		return -1.0f;
+	}
+	float score = 0.0f;
+	if (cachePos >= 0) {
+		score = cachePos < 3 ? 0.75f : powf(1.0f - (cachePos - 3) / (float)(VCACHE_SIZE - 3), 1.5f);
+	}
+	return score + 2.0f / sqrtf((float)valence);
+}
+
+// Optimize Faces Function
+// @param
+// - faces: the faces to reorder, in place
+// - vertexCount: the number of vertices the faces index
+// @description
+// - Reorders faces for post-transform vertex cache reuse with Tom Forsyth's
+//   linear-speed algorithm: keeps an LRU model of the cache, always emits
+//   the highest scoring triangle touching a cached vertex, and falls back to
+//   the next unemitted triangle in the original order when none is left.
+//   Only the face order changes, the vertices and winding stay as they are.
+void optimizeFaces(vector<uvec3> &faces, int vertexCount) {
+	const int triCount = faces.size();
+
+	// triangles using each vertex, packed by vertex
+	vector<int> valence(vertexCount, 0);
+	for (int t = 0; t < triCount; t++) {
+		for (int k = 0; k < 3; k++) {
+			valence[faces[t][k]]++;
+		}
+	}
+	vector<int> first(vertexCount + 1, 0);
+	for (int v = 0; v < vertexCount; v++) {
+		first[v + 1] = first[v] + valence[v];
+	}
+	vector<int> tris(first[vertexCount]);
+	vector<int> fill(first.begin(), first.end() - 1);
+	for (int t = 0; t < triCount; t++) {
+		for (int k = 0; k < 3; k++) {
+			tris[fill[faces[t][k]]++] = t;
+		}
+	}
+
+	vector<int> cachePos(vertexCount, -1);
+	vector<float> vScore(vertexCount);
+	for (int v = 0; v < vertexCount; v++) {
+		vScore[v] = vertexScore(-1, valence[v]);
+	}
+	vector<float> tScore(triCount);
+	for (int t = 0; t < triCount; t++) {
+		tScore[t] = vScore[faces[t].x] + vScore[faces[t].y] + vScore[faces[t].z];
+	}
+	vector<char> emitted(triCount, 0);
+	vector<int> cache, next;
+	cache.reserve(VCACHE_SIZE + 3);
+	next.reserve(VCACHE_SIZE + 3);
+
+	vector<uvec3> out;
+	out.reserve(triCount);
+	int best = -1;
+	int cursor = 0;
+	while ((int)out.size() < triCount) {
+		if (best < 0) {
+			while (emitted[cursor]) {
+				cursor++;
+			}
+			best = cursor;
+		}
+		emitted[best] = 1;
+		out.push_back(faces[best]);
+
+		// take the triangle off its vertices' lists and move them to the front of the cache
+		next.clear();
+		for (int k = 0; k < 3; k++) {
+			int v = faces[best][k];
+			int *list = &tris[first[v]];
+			for (int i = 0; i < valence[v]; i++) {
+				if (list[i] == best) {
+					list[i] = list[--valence[v]];
+					break;
+				}
+			}
+			if (std::find(next.begin(), next.end(), v) == next.end()) {
+				next.push_back(v);
+			}
+		}
+		const int corners = next.size();
+		for (size_t i = 0; i < cache.size(); i++) {
+			if (std::find(next.begin(), next.begin() + corners, cache[i]) == next.begin() + corners) {
+				next.push_back(cache[i]);
+			}
+		}
+
+		// rescore everything that moved, including the vertices pushed out
+		for (size_t i = 0; i < next.size(); i++) {
+			int v = next[i];
+			cachePos[v] = i < VCACHE_SIZE ? (int)i : -1;
+			vScore[v] = vertexScore(cachePos[v], valence[v]);
+		}
+		best = -1;
+		float bestScore = -1.0f;
+		for (size_t i = 0; i < next.size(); i++) {
+			int v = next[i];
+			for (int j = 0; j < valence[v]; j++) {
+				int t = tris[first[v] + j];
+				tScore[t] = vScore[faces[t].x] + vScore[faces[t].y] + vScore[faces[t].z];
+				if (i < VCACHE_SIZE && tScore[t] > bestScore) {
+					bestScore = tScore[t];
+					best = t;
+				}
+			}
+		}
+		if (next.size() > VCACHE_SIZE) {
+			next.resize(VCACHE_SIZE);
+		}
+		cache.swap(next);
+	}
+	faces.swap(out);
+}
+
+// Vertex Cache Stats Function
+// @param
+// - faces: the faces in draw order
+// - vertexCount: the number of vertices the faces index
+// - cacheSize: entries in the simulated FIFO cache
+// @description
+// - Counts the vertex transforms a FIFO post-transform cache of the given
+//   size would do drawing the faces in order.
+VertexCacheStats vertexCacheStats(const vector<uvec3> &faces, int vertexCount, int cacheSize) {
+	vector<int> stamp(vertexCount, -1); // miss count when the vertex last entered the cache
+	vector<char> used(vertexCount, 0);
+	int misses = 0;
+	int referenced = 0;
+	for (size_t t = 0; t < faces.size(); t++) {
+		for (int k = 0; k < 3; k++) {
+			int v = faces[t][k];
+			if (stamp[v] < 0 || misses - stamp[v] >= cacheSize) {
+				stamp[v] = misses++;
+			}
+			if (!used[v]) {
+				used[v] = 1;
+				referenced++;
+			}
+		}
+	}
+	VertexCacheStats stats;
+	stats.acmr = faces.empty() ? 0.0f : misses / (float)faces.size();
+	stats.atvr = referenced ? misses / (float)referenced : 0.0f;
+	return stats;
+}
@@ -1,3 +1,7 @@
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <iostream>
+#include <cstdlib>
 #include "debuggl.h"
 
 const char* DebugGLErrorToString(int error) {
@@ -23,3 +27,44 @@ const char* DebugGLErrorToString(int error) {
 	}
 	return "Unicorns Exist";
 }
+
+// Debug Message Callback
+// @description
+// - Receives KHR_debug messages. Errors end the program in debug builds,
+//   where output is synchronous and a debugger stops inside the failing
+//   call; release builds only log them since the call is long gone by then.
+static void GLAPIENTRY DebugGLMessage(GLenum source, GLenum type, GLuint id, GLenum severity,
+	GLsizei length, const GLchar* message, const void* user) {
+	std::cerr << "OpenGL " << (type == GL_DEBUG_TYPE_ERROR ? "Error" : "Message")
+		<< " (id " << id << ", severity 0x" << std::hex << severity << std::dec << "): "
+		<< message << "\n";
+#ifndef NDEBUG
+	if (type == GL_DEBUG_TYPE_ERROR) {
+		glfwTerminate();
+		exit(EXIT_FAILURE);
+	}
+#endif
+}
+
+// Debug GL Enable Output Function
+// @description
+// - Installs the KHR_debug message callback, ignoring notifications.
+//   Synchronous in debug builds, asynchronous in release builds. Returns
+//   false (and errors go unreported unless built with DEBUGGL_GETERROR) when
+//   the context doesn't support KHR_debug. Call once the context is current
+//   and GLEW is initialized.
+bool DebugGLEnableOutput() {
+	if (!GLEW_KHR_debug && !GLEW_VERSION_4_3) {
+#ifndef DEBUGGL_GETERROR
+		std::cerr << "KHR_debug is not available, build with DEBUGGL_GETERROR to check GL errors\n";
+#endif
+		return false;
+	}
+	glEnable(GL_DEBUG_OUTPUT);
+#ifndef NDEBUG
+	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+#endif
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+	glDebugMessageCallback(DebugGLMessage, nullptr);
+	return true;
+}
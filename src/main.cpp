@@ -1,28 +1,60 @@
 #include "interface.h"
 
+// Per-frame constants shared by every program. Prepended to each shader source
+// below, and laid out std140 so it matches FrameUniforms in interface.h.
+const char* frameBlockSrc =
+R"zzz(#version 330 core
+layout(std140) uniform Frame {
+	mat4 projection;
+	mat4 view;
+	vec4 lPos;
+	vec4 cPos;
+	vec4 sceneCol;
+	float fogDist;
+	float ambConst;
+	float seaLev;
+	int time;
+};
+)zzz";
+
 // C++ 11 String Literal
 // See http://en.cppreference.com/w/cpp/language/string_literal
 const char* tVertexShaderSrc =
-R"zzz(#version 330 core
-in vec4 vPos;
+R"zzz(in vec4 vPos;
 in vec4 vNorm;
 in vec2 vUV;
 in float temp;
 in float height;
-uniform mat4 view;
-uniform mat4 projection;
-uniform vec4 lPos;
-uniform vec4 cPos;
 out vec4 lDir;
 out vec4 cDir;
 out vec4 normal;
 out vec2 UV;
-out float fTemp;
-out float fHeight;
+out vec4 matLo; // blend weights of material layers 0-3
+out vec4 matHi; // blend weights of material layers 4-7
+out float fWater;
 out vec4 diffuse;
 out vec4 wPos;
 out vec4 cDist;
 
+// layers of the material array, in atlas order
+const int DIRT = 0;
+const int SNOW = 1;
+const int GRAVEL = 2;
+const int GRASS = 4;
+const int ICE = 5;
+const int ROCK = 6;
+const int SAND = 7;
+const int MAX_MATERIALS = 4; // most layers a fragment will blend
+
+// lays a material over the blend so far with the given coverage
+void cover(inout float w[8], int layer, float amount)
+{
+	for (int i = 0; i < 8; i++) {
+		w[i] *= 1.0 - amount;
+	}
+	w[layer] += amount;
+}
+
 void main()
 {
     // Compute color values based on temperature 0*F = Blue, 100*F = Red
@@ -45,9 +77,40 @@ void main()
 	// pass UV to fragment shader
 	UV = vUV;
 
-	// pass height and temperature to fragment shader
-	fTemp = temp;
-	fHeight = height;
+	// height and temp modifiers
+	float hMod = clamp(log(-height+5.0)+0.5, 0.0, 1.0);
+	float saMod = clamp((temp  - 75.0)/5.0+0.5,0.0,1.0);
+	float rMod = clamp(-(temp  - 45.0)/5.0+1.0,0.0,1.0);
+	float dMod = clamp(-(temp  - 70.0)/5.0+1.0,0.0,1.0);
+	float iMod = clamp(-(temp - 32.0)/10.0+0.25,0.0,1.0);
+	float snMod = clamp(-(temp - 16.0)/15.0+1.0,0.0,1.0);
+	float gMod = clamp(sin(temp/13-3.05),0.0,1.0);
+	float grMod = clamp(-(temp - 35.0)/10.0+0.25,0.0,1.0);
+	float slMod = clamp(log(-height + 1.0 + seaLev) + 1.0, 0.0, 1.0);
+	fWater = clamp(log(-height + 0.5 + seaLev)/2.5, 0.0, 1.0);
+
+	// classify the vertex into material weights, starting from bare dirt
+	float w[8] = float[8](1.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+	cover(w, ROCK, 1.0 - (1.0 - hMod)*(1.0 - rMod));
+	cover(w, ICE, iMod);
+	cover(w, SNOW, snMod);
+	cover(w, GRASS, hMod*gMod);
+	cover(w, SAND, saMod);
+	cover(w, DIRT, slMod*dMod);
+	cover(w, GRAVEL, slMod*grMod);
+
+	// keep only the strongest few so the fragment shader samples fewer layers
+	float total = 0.0;
+	for (int i = 0; i < 8; i++) {
+		int rank = 0;
+		for (int j = 0; j < 8; j++) {
+			rank += (w[j] > w[i] || (w[j] == w[i] && j < i)) ? 1 : 0;
+		}
+		w[i] = rank < MAX_MATERIALS ? w[i] : 0.0;
+		total += w[i];
+	}
+	matLo = vec4(w[0], w[1], w[2], w[3]) / total;
+	matHi = vec4(w[4], w[5], w[6], w[7]) / total;
 
     // Set diffuse color according to temperature
 	diffuse = vec4(R, G, B, 1.0);
@@ -55,85 +118,49 @@ void main()
 )zzz";
 
 const char* tFragmentShaderSrc =
-R"zzz(#version 330 core
-in vec4 normal;
+R"zzz(in vec4 normal;
 in vec4 lDir;
 in vec4 cDir;
 in vec4 cDist;
 in vec2 UV;
-in float fTemp;
-in float fHeight;
+in vec4 matLo;
+in vec4 matHi;
+in float fWater;
 in vec4 diffuse;
-uniform float ambConst;
 uniform vec4 ambient;
 uniform vec4 specular;
-uniform vec4 sceneCol;
-uniform float fogDist;
 uniform float shininess;
-uniform sampler2D dirtTex;
-uniform sampler2D snowTex;
-uniform sampler2D gravelTex;
-uniform sampler2D grassTex;
-uniform sampler2D iceTex;
-uniform sampler2D rockTex;
-uniform sampler2D sandTex;
-uniform float seaLev;
+uniform sampler2DArray materials;
 out vec4 fCol;
 
+const float MIN_WEIGHT = 0.004; // layers weighted below this are not sampled
+
 void main()
 {
 	vec3 N = normalize(normal.xyz);
 	vec3 L = normalize(lDir.xyz);
 	vec3 C = normalize(cDir.xyz);
-	vec4 tex = texture2D(dirtTex, UV);
-	vec4 dirtTex = texture2D(dirtTex, UV);
-	vec4 sandTex = texture2D(sandTex, UV);
-	vec4 rockTex = texture2D(rockTex, UV);
-	vec4 grassTex = texture2D(grassTex, UV);
-	vec4 iceTex = texture2D(iceTex, UV);
-	vec4 snowTex = texture2D(snowTex, UV);
-	vec4 gravelTex = texture2D(gravelTex, UV);
-
-	// height and temp modifiers
-	float hMod = clamp(log(-fHeight+5.0)+0.5, 0.0, 1.0);
-	float snHMod = clamp(cos((fHeight + 0.5)/(1.0*3.14159))/1.5 + 0.5,0.0,1.0);
-	float saMod = clamp((fTemp  - 75.0)/5.0+0.5,0.0,1.0);
-	float rMod = clamp(-(fTemp  - 45.0)/5.0+1.0,0.0,1.0);
-	float dMod = clamp(-(fTemp  - 70.0)/5.0+1.0,0.0,1.0);
-	float iMod = clamp(-(fTemp - 32.0)/10.0+0.25,0.0,1.0);
-	float snMod = clamp(-(fTemp - 16.0)/15.0+1.0,0.0,1.0);
-	float gMod = clamp(sin(fTemp/13-3.05),0.0,1.0);
-	float grMod = clamp(-(fTemp - 35.0)/10.0+0.25,0.0,1.0);
-	float slMod = clamp(log(-fHeight + 1.0 + seaLev) + 1.0, 0.0, 1.0);
-	float wfMod = clamp(log(-fHeight + 0.5 + seaLev)/2.5, 0.0, 1.0);
-
-	// add in rock
-	tex = (1.0 - hMod)*((1.0 - rMod)*tex + rMod*rockTex) + hMod*rockTex;
-
-	// add ice
-	tex = (1.0-iMod)*tex + iMod*iceTex;
-
-	// add snow
-	tex = (1.0-snMod)*tex + snMod*snowTex;
-
-	// Add in grass
-	tex = hMod*((1.0-gMod)*tex + gMod*grassTex) + (1.0-hMod)*tex;
-
-
-	// add in sand
-	tex = (1.0 - slMod) * ((1.0-saMod)*tex + saMod*sandTex) + slMod * ((1.0 - saMod) * tex + saMod*sandTex);
-
-	// add in mud
-	tex = (1.0 - slMod) * tex + slMod * ((1.0 - dMod) * tex + dMod * dirtTex);
 
-	// add in gravel
-	tex = (1.0 - slMod) * tex + slMod * ((1.0 - grMod) * tex + grMod * gravelTex);
+	// blend only the layers the vertices were classified into. Gradients are
+	// taken up front since the samples sit in non-uniform control flow.
+	vec2 dx = dFdx(UV);
+	vec2 dy = dFdy(UV);
+	float w[8] = float[8](matLo.x, matLo.y, matLo.z, matLo.w, matHi.x, matHi.y, matHi.z, matHi.w);
+	vec4 tex = vec4(0.0);
+	float total = 0.0;
+	for (int i = 0; i < 8; i++) {
+		if (w[i] > MIN_WEIGHT) {
+			tex += w[i] * textureGrad(materials, vec3(UV, float(i)), dx, dy);
+			total += w[i];
+		}
+	}
+	tex /= max(total, MIN_WEIGHT);
 
 	// add in blue for areas under water
-	float aquaC = 1.0 - wfMod;
-	vec4 wBlue = wfMod * vec4(0.0, aquaC*0.67, aquaC, 1.0);
-		 wBlue += (clamp(wfMod-0.5,0.0,1.0)) * vec4(0.0, 0.0, aquaC*0.5, 1.0);
-	tex = (1.0 - wfMod) * tex + wBlue;
+	float aquaC = 1.0 - fWater;
+	vec4 wBlue = fWater * vec4(0.0, aquaC*0.67, aquaC, 1.0);
+		 wBlue += (clamp(fWater-0.5,0.0,1.0)) * vec4(0.0, 0.0, aquaC*0.5, 1.0);
+	tex = (1.0 - fWater) * tex + wBlue;
 	
 	// calculate ambient component
 	 vec3 amb = ambConst * ambient.xyz + diffuse.xyz * (ambConst / 2.0);
@@ -158,16 +185,9 @@ void main()
 
 // WATER SHADERS!! >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
 const char* wVertexShaderSrc =
-R"zzz(#version 330 core
-in vec4 vPos;
+R"zzz(in vec4 vPos;
 in vec4 vNorm;
 in vec2 vUV;
-uniform mat4 view;
-uniform mat4 projection;
-uniform vec4 lPos;
-uniform vec4 cPos;
-uniform int time;
-uniform float seaLev;
 out vec4 lDir;
 out vec4 cDir;
 out vec4 cDist;
@@ -249,30 +269,27 @@ void main()
 )zzz";
 
 const char* wFragmentShaderSrc =
-R"zzz(#version 330 core
-in vec4 normal;
+R"zzz(in vec4 normal;
 in vec4 lDir;
 in vec4 cDir;
 in vec4 cDist;
 in vec2 UV;
 in vec4 diffuse;
 in vec4 wPos;
-uniform float ambConst;
 uniform vec4 ambient;
-uniform vec4 sceneCol;
-uniform float fogDist;
 uniform vec4 specular;
 uniform float shininess;
-uniform int time;
-uniform sampler2D texMap;
+uniform sampler2DArray materials;
 out vec4 fCol;
 
+const float WATER = 3.0; // water layer of the material array
+
 void main()
 {
 	vec3 N = normalize(normal.xyz);
 	vec3 L = normalize(lDir.xyz);
 	vec3 C = normalize(cDir.xyz);
-	vec4 waterTex = texture2D(texMap, UV);
+	vec4 waterTex = texture(materials, vec3(UV, WATER));
 	vec4 tex = 0.5*waterTex + 0.5*diffuse;
 
 	// calculate ambient component
@@ -305,6 +322,7 @@ void ErrorCallback(int error, const char* description)
 }
 
 void run_opengl() {
+	Trace::nameThread("render");
 	if (!glfwInit()) exit(EXIT_FAILURE);
 	glfwSetErrorCallback(ErrorCallback);
 
@@ -314,6 +332,9 @@ void run_opengl() {
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifndef NDEBUG
+	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE); // full KHR_debug reporting
+#endif
 	const GLFWvidmode* mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
 	centerX = mode->width / 2.0;
 	centerY = mode->height / 2.0;
@@ -328,6 +349,7 @@ void run_opengl() {
 
 	CHECK_SUCCESS(glewInit() == GLEW_OK);
 	glGetError();  // clear GLEW's error for it
+	DebugGLEnableOutput();
 	glfwSetKeyCallback(gl_window, KeyCallback);
 	glfwSetCursorPosCallback(gl_window, MousePosCallback);
 	glfwSetMouseButtonCallback(gl_window, MouseButtonCallback);
@@ -345,24 +367,7 @@ void run_opengl() {
 	unsigned int width, height;
 	unsigned int imageSize; // = width*height
 	unsigned char* data; // the actual data for the image
-	unsigned char* dirtData;
-	unsigned char* snowData;
-	unsigned char* gravelData;
-	unsigned char* waterData;
-	unsigned char* grassData;
-	unsigned char* iceData;
-	unsigned char* rockData;
-	unsigned char* sandData;
-
-	GLuint texID = 0; // our texture object to return
-	GLuint dirtTex = 0;
-	GLuint snowTex = 0;
-	GLuint gravelTex = 0;
-	GLuint waterTex = 0; // our water texture
-	GLuint grassTex = 0;
-	GLuint iceTex = 0;
-	GLuint rockTex = 0;
-	GLuint sandTex = 0;
+	GLuint materialTex = 0; // texture array with one layer per material
 	FILE* file = fopen(imagepath, "rb");
 
 	// This is here for debugging
@@ -397,7 +402,6 @@ void run_opengl() {
 	imageSize = *(int*)&(header[0x22]);
 	width = *(int*)&(header[0x12]);
 	height = *(int*)&(header[0x16]);
-	int subImgSize = (width / 4)*(height / 2) * 3; // the size of an individual texture in the atlas
 
 												   // This is here to ensure image is set up correctly (in case header information 
 												   // is missing or corrupted and was not caught by debug statements)
@@ -413,118 +417,61 @@ void run_opengl() {
 	fread(data, 1, imageSize, file);
 	fclose(file);
 
-	// Load in our texture to our texture object
-	glGenTextures(1, &texID);
+	// Load the atlas into a texture array, one layer per material. The atlas is
+	// four materials wide and two tall; each layer is read straight out of the
+	// file data by setting the unpack window rather than copying it out first.
+	const int layerW = width / 4;
+	const int layerH = height / 2;
+	const int layers = 8;
+	glGenTextures(1, &materialTex);
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texID);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, materialTex);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB8, layerW, layerH, layers, 0, GL_BGR, GL_UNSIGNED_BYTE, nullptr);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+	for (int layer = 0; layer < layers; layer++) {
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS, (layer % 4) * layerW);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS, (layer / 4) * layerH);
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, layerW, layerH, 1, GL_BGR, GL_UNSIGNED_BYTE, data);
+	}
+	glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	delete[] data;
 	// END LOAD TEXTURES INTO OPENGL
 
-	dirtData = new unsigned char[subImgSize];
-	snowData = new unsigned char[subImgSize];
-	gravelData = new unsigned char[subImgSize];
-	waterData = new unsigned char[subImgSize];
-	grassData = new unsigned char[subImgSize];
-	iceData = new unsigned char[subImgSize];
-	rockData = new unsigned char[subImgSize];
-	sandData = new unsigned char[subImgSize];
-
-	int subW = (width / 4) * 3;
-	int subH = (height / 2);
-	int count = 0;
-	for (int i = 0; i < subH; i++) {
-		for (int j = 0; j < subW; j++) {
-			dirtData[count] = data[i*width * 3 + j];
-			snowData[count] = data[i*width * 3 + j + subW];
-			gravelData[count] = data[i*width * 3 + j + subW * 2];
-			waterData[count] = data[i*width * 3 + j + +subW * 3];
-			grassData[count] = data[i*width * 3 + j + subImgSize * 4];
-			iceData[count] = data[i*width * 3 + j + subImgSize * 4 + subW];
-			rockData[count] = data[i*width * 3 + j + subImgSize * 4 + subW * 2];
-			sandData[count] = data[i*width * 3 + j + subImgSize * 4 + subW * 3];
-			count++;
+	// Init map data
+	std::unique_ptr<Occulus> single(Occulus::create(camera.getEye(), viewDim, genBudget)); // streams in over the first frames
+	single->draw(tVertices, tNormals, tUv, tTemps, tHeights, tFaces);
+	single->drawWater(wVertices, wUV, wFaces);
+
+	// One 16-bit index buffer holds the face maps of a terrain chunk and of a
+	// water chunk; every chunk is drawn from it with its own base vertex.
+	for (size_t f = 0; f < tFaces.size(); f++) {
+		for (int k = 0; k < 3; k++) {
+			sharedIndices.push_back((GLushort)tFaces[f][k]);
 		}
 	}
-	glGenTextures(1, &dirtTex);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, dirtTex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width / 4, height / 2, 0, GL_BGR, GL_UNSIGNED_BYTE, dirtData);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-	glGenTextures(1, &snowTex);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, snowTex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width / 4, height / 2, 0, GL_BGR, GL_UNSIGNED_BYTE, snowData);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-	glGenTextures(1, &gravelTex);
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, gravelTex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width / 4, height / 2, 0, GL_BGR, GL_UNSIGNED_BYTE, gravelData);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-	glGenTextures(1, &waterTex);
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, waterTex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width / 4, height / 2, 0, GL_BGR, GL_UNSIGNED_BYTE, waterData);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-	glGenTextures(1, &grassTex);
-	glActiveTexture(GL_TEXTURE4);
-	glBindTexture(GL_TEXTURE_2D, grassTex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width / 4, height / 2, 0, GL_BGR, GL_UNSIGNED_BYTE, grassData);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-	glGenTextures(1, &iceTex);
-	glActiveTexture(GL_TEXTURE5);
-	glBindTexture(GL_TEXTURE_2D, iceTex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width / 4, height / 2, 0, GL_BGR, GL_UNSIGNED_BYTE, iceData);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-	glGenTextures(1, &rockTex);
-	glActiveTexture(GL_TEXTURE6);
-	glBindTexture(GL_TEXTURE_2D, rockTex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width / 4, height / 2, 0, GL_BGR, GL_UNSIGNED_BYTE, rockData);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-	glGenTextures(1, &sandTex);
-	glActiveTexture(GL_TEXTURE7);
-	glBindTexture(GL_TEXTURE_2D, sandTex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width / 4, height / 2, 0, GL_BGR, GL_UNSIGNED_BYTE, sandData);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-	// Init map data
-	Occulus single = Occulus(camera.getEye());
-	single.draw(tVertices, tNormals, tUv, tTemps, tHeights, tFaces);
-	single.drawWater(wVertices, wUV, wFaces);
+	for (size_t f = 0; f < wFaces.size(); f++) {
+		for (int k = 0; k < 3; k++) {
+			sharedIndices.push_back((GLushort)wFaces[f][k]);
+		}
+	}
+	const GLvoid *wIndexOffset = (const GLvoid*)(sizeof(GLushort) * tFaces.size() * 3);
+
+	// every terrain chunk is drawn every frame
+	const int tChunks = single->chunksPerSide() * single->chunksPerSide();
+	tCounts.assign(tChunks, tFaces.size() * 3);
+	tOffsets.assign(tChunks, nullptr);
+	for (int c = 0; c < tChunks; c++) {
+		tBaseVertices.push_back(c * single->chunkSize());
+	}
 
 
 	/*
@@ -535,6 +482,9 @@ void run_opengl() {
 	// Setup our VAO array.
 	CHECK_GL_ERROR(glGenVertexArrays(kNumVaos, &gArrayObjects[0]));
 
+	// Linked programs from earlier runs on this driver.
+	ProgramCache programCache("./cache");
+
 	// Switch to the VAO for Geometry.
 	CHECK_GL_ERROR(glBindVertexArray(gArrayObjects[kGeometryVao]));
 
@@ -586,110 +536,59 @@ void run_opengl() {
 	CHECK_GL_ERROR(glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, 0, 0));
 	CHECK_GL_ERROR(glEnableVertexAttribArray(4));
 
-	// Setup element array buffer.
+	// Setup element array buffer, shared with the water.
 	CHECK_GL_ERROR(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gBufferObjects[kGeometryVao][kIndexBuffer]));
 	CHECK_GL_ERROR(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-		sizeof(uint32_t) * tFaces.size() * 3,
-		&tFaces[0], GL_STATIC_DRAW));
-
-	// Setup vertex shader.
-	GLuint tVertexShader = 0;
-	const char* tVertexShaderSrcPtr = tVertexShaderSrc;
-
-	CHECK_GL_ERROR(tVertexShader = glCreateShader(GL_VERTEX_SHADER));
-	CHECK_GL_ERROR(glShaderSource(tVertexShader, 1, &tVertexShaderSrcPtr, nullptr));
-	glCompileShader(tVertexShader);
-	CHECK_GL_SHADER_ERROR(tVertexShader);
-
-	// Setup fragment shader.
-	GLuint tFragmentShader = 0;
-	const char* tFragmentShaderSrcPtr = tFragmentShaderSrc;
-	CHECK_GL_ERROR(tFragmentShader = glCreateShader(GL_FRAGMENT_SHADER));
-	CHECK_GL_ERROR(glShaderSource(tFragmentShader, 1, &tFragmentShaderSrcPtr, nullptr));
-	glCompileShader(tFragmentShader);
-	CHECK_GL_SHADER_ERROR(tFragmentShader);
-
-	// Let's create our program.
+		sizeof(GLushort) * sharedIndices.size(),
+		&sharedIndices[0], GL_STATIC_DRAW));
+
+	// Let's create our program, straight from the binary cache when it has it.
 	GLuint tProgram = 0;
 	CHECK_GL_ERROR(tProgram = glCreateProgram());
-	CHECK_GL_ERROR(glAttachShader(tProgram, tVertexShader));
-	CHECK_GL_ERROR(glAttachShader(tProgram, tFragmentShader));
+	const char* tProgramSrcs[] = { frameBlockSrc, tVertexShaderSrc, tFragmentShaderSrc };
+	if (!programCache.load(tProgram, tProgramSrcs, 3)) {
+		// Setup vertex shader.
+		GLuint tVertexShader = 0;
+		const char* tVertexShaderSrcPtr = tVertexShaderSrc;
+		CHECK_GL_ERROR(tVertexShader = glCreateShader(GL_VERTEX_SHADER));
+		const char* tVertexShaderSrcs[] = { frameBlockSrc, tVertexShaderSrcPtr };
+		CHECK_GL_ERROR(glShaderSource(tVertexShader, 2, tVertexShaderSrcs, nullptr));
+		glCompileShader(tVertexShader);
+		CHECK_GL_SHADER_ERROR(tVertexShader);
+
+		// Setup fragment shader.
+		GLuint tFragmentShader = 0;
+		const char* tFragmentShaderSrcPtr = tFragmentShaderSrc;
+		CHECK_GL_ERROR(tFragmentShader = glCreateShader(GL_FRAGMENT_SHADER));
+		const char* tFragmentShaderSrcs[] = { frameBlockSrc, tFragmentShaderSrcPtr };
+		CHECK_GL_ERROR(glShaderSource(tFragmentShader, 2, tFragmentShaderSrcs, nullptr));
+		glCompileShader(tFragmentShader);
+		CHECK_GL_SHADER_ERROR(tFragmentShader);
+
+		// Link our program.
+		CHECK_GL_ERROR(glAttachShader(tProgram, tVertexShader));
+		CHECK_GL_ERROR(glAttachShader(tProgram, tFragmentShader));
+
+		// Bind attributes.
+		CHECK_GL_ERROR(glBindAttribLocation(tProgram, 0, "vPos"));
+		CHECK_GL_ERROR(glBindAttribLocation(tProgram, 1, "vNorm"));
+		CHECK_GL_ERROR(glBindAttribLocation(tProgram, 2, "temp"));
+		CHECK_GL_ERROR(glBindAttribLocation(tProgram, 3, "height"));
+		CHECK_GL_ERROR(glBindAttribLocation(tProgram, 4, "vUV"));
+		CHECK_GL_ERROR(glBindFragDataLocation(tProgram, 0, "fCol"));
+		glLinkProgram(tProgram);
+		CHECK_GL_PROGRAM_ERROR(tProgram);
+		programCache.store(tProgram, tProgramSrcs, 3);
+	}
 
-	CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER, gBufferObjects[kGeometryVao][kVertexBuffer]));
-	// NOTE: We do not send anything right now, we just describe it to OpenGL.
-	CHECK_GL_ERROR(glBufferData(GL_ARRAY_BUFFER,
-		sizeof(float) * tVertices.size() * 4, nullptr,
-		GL_STATIC_DRAW));
-	CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER, gBufferObjects[kGeometryVao][kNormalBuffer]));
-	// NOTE: We do not send anything right now, we just describe it to OpenGL.
-	CHECK_GL_ERROR(glBufferData(GL_ARRAY_BUFFER,
-		sizeof(float) * tNormals.size() * 4, nullptr,
-		GL_STATIC_DRAW));
-	// Bind attributes.
-	CHECK_GL_ERROR(glBindAttribLocation(tProgram, 0, "vPos"));
-	CHECK_GL_ERROR(glBindAttribLocation(tProgram, 1, "vNorm"));
-	CHECK_GL_ERROR(glBindAttribLocation(tProgram, 2, "temp"));
-	CHECK_GL_ERROR(glBindAttribLocation(tProgram, 3, "height"));
-	CHECK_GL_ERROR(glBindAttribLocation(tProgram, 4, "vUV"));
-	CHECK_GL_ERROR(glBindFragDataLocation(tProgram, 0, "fCol"));
-	glLinkProgram(tProgram);
-	CHECK_GL_PROGRAM_ERROR(tProgram);
-
-	// Get the uniform locations.
-	GLint projMatLoc = 0;
-	CHECK_GL_ERROR(projMatLoc =
-		glGetUniformLocation(tProgram, "projection"));
-	GLint viewMatLoc = 0;
-	CHECK_GL_ERROR(viewMatLoc =
-		glGetUniformLocation(tProgram, "view"));
-	GLint lPosLoc = 0;
-	CHECK_GL_ERROR(lPosLoc =
-		glGetUniformLocation(tProgram, "lPos"));
-	GLint cPosLoc = 0;
-	CHECK_GL_ERROR(cPosLoc =
-		glGetUniformLocation(tProgram, "cPos"));
-	GLint sceneColLoc = 0;
-	CHECK_GL_ERROR(sceneColLoc =
-		glGetUniformLocation(tProgram, "sceneCol"));
-	GLint fogDistLoc = 0;
-	CHECK_GL_ERROR(fogDistLoc =
-		glGetUniformLocation(tProgram, "fogDist"));
-	GLint ambCLoc = 0;
-	CHECK_GL_ERROR(ambCLoc =
-		glGetUniformLocation(tProgram, "ambConst"));
-	GLint ambLoc = 0;
-	CHECK_GL_ERROR(ambLoc =
-		glGetUniformLocation(tProgram, "ambient"));
-	GLint specLoc = 0;
-	CHECK_GL_ERROR(specLoc =
-		glGetUniformLocation(tProgram, "specular"));
-	GLint shinyLoc = 0;
-	CHECK_GL_ERROR(shinyLoc =
-		glGetUniformLocation(tProgram, "shininess"));
-	GLint dirtTexLoc = 0;
-	CHECK_GL_ERROR(dirtTexLoc =
-		glGetUniformLocation(tProgram, "dirtTex"));
-	GLint snowTexLoc = 0;
-	CHECK_GL_ERROR(snowTexLoc =
-		glGetUniformLocation(tProgram, "snowTex"));
-	GLint gravelTexLoc = 0;
-	CHECK_GL_ERROR(gravelTexLoc =
-		glGetUniformLocation(tProgram, "gravelTex"));
-	GLint grassTexLoc = 0;
-	CHECK_GL_ERROR(grassTexLoc =
-		glGetUniformLocation(tProgram, "grassTex"));
-	GLint iceTexLoc = 0;
-	CHECK_GL_ERROR(iceTexLoc =
-		glGetUniformLocation(tProgram, "iceTex"));
-	GLint rockTexLoc = 0;
-	CHECK_GL_ERROR(rockTexLoc =
-		glGetUniformLocation(tProgram, "rockTex"));
-	GLint sandTexLoc = 0;
-	CHECK_GL_ERROR(sandTexLoc =
-		glGetUniformLocation(tProgram, "sandTex"));
-	GLint seaLevLoc = 0;
-	CHECK_GL_ERROR(seaLevLoc =
-		glGetUniformLocation(tProgram, "seaLev"));
+	// Share the per-frame block and set the constants that never change.
+	CHECK_GL_ERROR(glUniformBlockBinding(tProgram,
+		glGetUniformBlockIndex(tProgram, "Frame"), kFrameBlock));
+	CHECK_GL_ERROR(glUseProgram(tProgram));
+	CHECK_GL_ERROR(glUniform4fv(glGetUniformLocation(tProgram, "ambient"), 1, &tAmbient[0]));
+	CHECK_GL_ERROR(glUniform4fv(glGetUniformLocation(tProgram, "specular"), 1, &tSpecular[0]));
+	CHECK_GL_ERROR(glUniform1f(glGetUniformLocation(tProgram, "shininess"), tShininess));
+	CHECK_GL_ERROR(glUniform1i(glGetUniformLocation(tProgram, "materials"), 0));
 
 
 	/*
@@ -701,8 +600,9 @@ void run_opengl() {
 	// Switch to the VAO for Geometry.
 	CHECK_GL_ERROR(glBindVertexArray(gArrayObjects[kWaterVao]));
 
-	// Generate buffer objects
-	CHECK_GL_ERROR(glGenBuffers(kNumVbos, &gBufferObjects[kWaterVao][0]));
+	// Generate buffer objects, just the vertices and UVs; the faces are the terrain's.
+	CHECK_GL_ERROR(glGenBuffers(1, &gBufferObjects[kWaterVao][kVertexBuffer]));
+	CHECK_GL_ERROR(glGenBuffers(1, &gBufferObjects[kWaterVao][kUVBuffer]));
 
 	// Setup vertex data in a VBO.
 	CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER, gBufferObjects[kWaterVao][kVertexBuffer]));
@@ -719,88 +619,62 @@ void run_opengl() {
 		sizeof(float) * wUV.size() * 2, nullptr,
 		GL_STATIC_DRAW));
 	CHECK_GL_ERROR(glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0));
-	CHECK_GL_ERROR(glEnableVertexAttribArray(2));
+	CHECK_GL_ERROR(glEnableVertexAttribArray(1));
 
-	// Setup element array buffer.
-	CHECK_GL_ERROR(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gBufferObjects[kWaterVao][kIndexBuffer]));
-	CHECK_GL_ERROR(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-		sizeof(uint32_t) * wFaces.size() * 3,
-		&wFaces[0], GL_STATIC_DRAW));
-
-	// Setup vertex shader.
-	GLuint wVertexShader = 0;
-	const char* wVertexShaderSrcPtr = wVertexShaderSrc;
-	CHECK_GL_ERROR(wVertexShader = glCreateShader(GL_VERTEX_SHADER));
-	CHECK_GL_ERROR(glShaderSource(wVertexShader, 1, &wVertexShaderSrcPtr, nullptr));
-	glCompileShader(wVertexShader);
-	CHECK_GL_SHADER_ERROR(wVertexShader);
-
-	// Setup fragment shader.
-	GLuint wFragmentShader = 0;
-	const char* wFragmentShaderSrcPtr = wFragmentShaderSrc;
-	CHECK_GL_ERROR(wFragmentShader = glCreateShader(GL_FRAGMENT_SHADER));
-	CHECK_GL_ERROR(glShaderSource(wFragmentShader, 1, &wFragmentShaderSrcPtr, nullptr));
-	glCompileShader(wFragmentShader);
-	CHECK_GL_SHADER_ERROR(wFragmentShader);
-
-	// Let's create our program.
+	// Use the terrain's element array buffer, the water's faces follow the terrain's.
+	CHECK_GL_ERROR(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gBufferObjects[kGeometryVao][kIndexBuffer]));
+
+	// Let's create our program, straight from the binary cache when it has it.
 	GLuint wProgram = 0;
 	CHECK_GL_ERROR(wProgram = glCreateProgram());
-	CHECK_GL_ERROR(glAttachShader(wProgram, wVertexShader));
-	CHECK_GL_ERROR(glAttachShader(wProgram, wFragmentShader));
+	const char* wProgramSrcs[] = { frameBlockSrc, wVertexShaderSrc, wFragmentShaderSrc };
+	if (!programCache.load(wProgram, wProgramSrcs, 3)) {
+		// Setup vertex shader.
+		GLuint wVertexShader = 0;
+		const char* wVertexShaderSrcPtr = wVertexShaderSrc;
+		CHECK_GL_ERROR(wVertexShader = glCreateShader(GL_VERTEX_SHADER));
+		const char* wVertexShaderSrcs[] = { frameBlockSrc, wVertexShaderSrcPtr };
+		CHECK_GL_ERROR(glShaderSource(wVertexShader, 2, wVertexShaderSrcs, nullptr));
+		glCompileShader(wVertexShader);
+		CHECK_GL_SHADER_ERROR(wVertexShader);
+
+		// Setup fragment shader.
+		GLuint wFragmentShader = 0;
+		const char* wFragmentShaderSrcPtr = wFragmentShaderSrc;
+		CHECK_GL_ERROR(wFragmentShader = glCreateShader(GL_FRAGMENT_SHADER));
+		const char* wFragmentShaderSrcs[] = { frameBlockSrc, wFragmentShaderSrcPtr };
+		CHECK_GL_ERROR(glShaderSource(wFragmentShader, 2, wFragmentShaderSrcs, nullptr));
+		glCompileShader(wFragmentShader);
+		CHECK_GL_SHADER_ERROR(wFragmentShader);
+
+		// Link our program.
+		CHECK_GL_ERROR(glAttachShader(wProgram, wVertexShader));
+		CHECK_GL_ERROR(glAttachShader(wProgram, wFragmentShader));
+
+		// Bind attributes.
+		CHECK_GL_ERROR(glBindAttribLocation(wProgram, 0, "vPos"));
+		CHECK_GL_ERROR(glBindAttribLocation(wProgram, 1, "vUV"));
+		CHECK_GL_ERROR(glBindFragDataLocation(wProgram, 0, "fCol"));
+		glLinkProgram(wProgram);
+		CHECK_GL_PROGRAM_ERROR(wProgram);
+		programCache.store(wProgram, wProgramSrcs, 3);
+	}
 
-	CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER, gBufferObjects[kWaterVao][kVertexBuffer]));
-	// NOTE: We do not send anything right now, we just describe it to OpenGL.
-	CHECK_GL_ERROR(glBufferData(GL_ARRAY_BUFFER,
-		sizeof(float) * wVertices.size() * 4, nullptr,
-		GL_STATIC_DRAW));
-	// Bind attributes.
-	CHECK_GL_ERROR(glBindAttribLocation(wProgram, 0, "vPos"));
-	CHECK_GL_ERROR(glBindAttribLocation(wProgram, 1, "vUV"));
-	CHECK_GL_ERROR(glBindFragDataLocation(wProgram, 0, "fCol"));
-	glLinkProgram(wProgram);
-	CHECK_GL_PROGRAM_ERROR(wProgram);
-
-	// Get the uniform locations.
-	GLint projMatLocW = 0;
-	CHECK_GL_ERROR(projMatLocW =
-		glGetUniformLocation(wProgram, "projection"));
-	GLint viewMatLocW = 0;
-	CHECK_GL_ERROR(viewMatLocW =
-		glGetUniformLocation(wProgram, "view"));
-	GLint lPosLocW = 0;
-	CHECK_GL_ERROR(lPosLocW =
-		glGetUniformLocation(wProgram, "lPos"));
-	GLint cPosLocW = 0;
-	CHECK_GL_ERROR(cPosLocW =
-		glGetUniformLocation(wProgram, "cPos"));
-	GLint ambCLocW = 0;
-	CHECK_GL_ERROR(ambCLocW =
-		glGetUniformLocation(wProgram, "ambConst"));
-	GLint ambLocW = 0;
-	CHECK_GL_ERROR(ambLocW =
-		glGetUniformLocation(wProgram, "ambient"));
-	GLint specLocW = 0;
-	CHECK_GL_ERROR(specLocW =
-		glGetUniformLocation(wProgram, "specular"));
-	GLint sceneColLocW = 0;
-	CHECK_GL_ERROR(sceneColLocW =
-		glGetUniformLocation(wProgram, "sceneCol"));
-	GLint fogDistLocW = 0;
-	CHECK_GL_ERROR(fogDistLocW =
-		glGetUniformLocation(wProgram, "fogDist"));
-	GLint shinyLocW = 0;
-	CHECK_GL_ERROR(shinyLocW =
-		glGetUniformLocation(wProgram, "shininess"));
-	GLint timeLocW = 0;
-	CHECK_GL_ERROR(timeLocW =
-		glGetUniformLocation(wProgram, "time"));
-	GLint texLocW = 0;
-	CHECK_GL_ERROR(texLocW =
-		glGetUniformLocation(wProgram, "texMap"));
-	GLint seaLevelW = 0;
-	CHECK_GL_ERROR(seaLevelW =
-		glGetUniformLocation(wProgram, "seaLev"));
+	// Share the per-frame block and set the constants that never change.
+	CHECK_GL_ERROR(glUniformBlockBinding(wProgram,
+		glGetUniformBlockIndex(wProgram, "Frame"), kFrameBlock));
+	CHECK_GL_ERROR(glUseProgram(wProgram));
+	CHECK_GL_ERROR(glUniform4fv(glGetUniformLocation(wProgram, "ambient"), 1, &wAmbient[0]));
+	CHECK_GL_ERROR(glUniform4fv(glGetUniformLocation(wProgram, "specular"), 1, &wSpecular[0]));
+	CHECK_GL_ERROR(glUniform1f(glGetUniformLocation(wProgram, "shininess"), wShininess));
+	CHECK_GL_ERROR(glUniform1i(glGetUniformLocation(wProgram, "materials"), 0));
+
+	// Per-frame uniform buffer, filled once a frame and read by both programs.
+	GLuint frameUbo = 0;
+	CHECK_GL_ERROR(glGenBuffers(1, &frameUbo));
+	CHECK_GL_ERROR(glBindBuffer(GL_UNIFORM_BUFFER, frameUbo));
+	CHECK_GL_ERROR(glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW));
+	CHECK_GL_ERROR(glBindBufferBase(GL_UNIFORM_BUFFER, kFrameBlock, frameUbo));
 
 	/*
 	================================================================================
@@ -817,8 +691,8 @@ void run_opengl() {
 	wVertices.clear();
 	wUV.clear();
 	wFaces.clear();
-	single.draw(tVertices, tNormals, tUv, tTemps, tHeights, tFaces);
-	single.drawWater(wVertices, wUV, wFaces);
+	single->draw(tVertices, tNormals, tUv, tTemps, tHeights, tFaces);
+	single->drawWater(wVertices, wUV, wFaces);
 
 	// Send vertices to the GPU. (Do outside loop for efficiency)
 	CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER,
@@ -845,8 +719,33 @@ void run_opengl() {
 		sizeof(float) * wUV.size() * 2,
 		&wUV[0], GL_STATIC_DRAW));
 
+	// a replayed camera path takes the place of user input
+	bool replaying = false;
+	int frame = 0;
+	if (!replayName.empty()) {
+		replaying = CameraPath::canned(replayName, replayFrames, cameraPath) || cameraPath.load(replayName);
+		if (!replaying) {
+			std::cerr << "Unknown camera path: " << replayName << "\n";
+		}
+	}
+
+	std::unique_ptr<GpuTimer> gpuTimer(new GpuTimer(kNumGpuScopes));
+	float gpuTimes[kNumGpuScopes] = { 0.0f, 0.0f, 0.0f };
+	double lastFrame = glfwGetTime();
 	while (!glfwWindowShouldClose(gl_window)) {
-		fps += 1;
+		TRACE_ZONE("frame");
+
+		// pick up GPU times from a few frames back, report the last frame's
+		// time, and wake the UI to show the stats now and then
+		gpuTimer->beginFrame();
+		bool gpuFresh = gpuTimer->read(gpuTimes); // most frames nothing new comes back
+		double now = glfwGetTime();
+		frameStats.frame((now - lastFrame) * 1000.0,
+			gpuFresh ? gpuTimes[kGpuUpload] + gpuTimes[kGpuTerrain] + gpuTimes[kGpuWater] : -1.0f);
+		lastFrame = now;
+		if (frameStats.due(now)) {
+			Fl::awake(frameStatsAwake, &frameStats);
+		}
 		// Setup some basic window stuff.
 		glfwGetFramebufferSize(gl_window, &winWidth, &winHeight);
 		glViewport(0, 0, winWidth, winHeight);
@@ -863,13 +762,38 @@ void run_opengl() {
 		// Switch to the Geometry VAO.
 		CHECK_GL_ERROR(glBindVertexArray(gArrayObjects[kGeometryVao]));
 
+		if (replaying) {
+			if (frame == (int)cameraPath.frames.size()) {
+				glfwSetWindowShouldClose(gl_window, GL_TRUE);
+				continue;
+			}
+			const CameraFrame &f = cameraPath.frames[frame];
+			camera.setEye(f.eye);
+			camera.setLook(f.look);
+			camera.setUp(f.up);
+			camera.setCenter(f.eye + camera.cameraDistance * f.look);
+			setRefresh = cameraPath.apply(frame) || setRefresh;
+		}
+		else if (!recordFile.empty()) {
+			cameraPath.record(camera.getEye(), camera.getLook(), camera.getUp());
+		}
+		frame++;
+
+		FrameTimes times;
+		auto stageStart = std::chrono::steady_clock::now();
 		if (!setRefresh) {
-			single.update(camera.getEye(), tHeights, tNormals, tTemps, tFaces);
+			single->move(camera.getEye());
 		}
 		else {
-			single.refresh();
+			single->refresh();
 			setRefresh = false;
 		}
+		auto stageEnd = std::chrono::steady_clock::now();
+		times.generate = std::chrono::duration<double, std::milli>(stageEnd - stageStart).count();
+		stageStart = stageEnd;
+		single->draw(tNormals, tTemps, tHeights);
+		stageEnd = std::chrono::steady_clock::now();
+		times.mesh = std::chrono::duration<double, std::milli>(stageEnd - stageStart).count();
 
 		// Compute the projection matrix.
 		aspect = static_cast<float>(winWidth) / winHeight;
@@ -887,50 +811,69 @@ void run_opengl() {
 		}
 
 		// Send normals, temps, and heights to the GPU for terrain generator
-		CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER,
-			gBufferObjects[kGeometryVao][kNormalBuffer]));
-		CHECK_GL_ERROR(glBufferData(GL_ARRAY_BUFFER,
-			sizeof(float) * tNormals.size() * 4,
-			&tNormals[0], GL_STATIC_DRAW));
-		CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER,
-			gBufferObjects[kGeometryVao][kTempBuffer]));
-		CHECK_GL_ERROR(glBufferData(GL_ARRAY_BUFFER,
-			sizeof(float) * tTemps.size(),
-			&tTemps[0], GL_STATIC_DRAW));
-		CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER,
-			gBufferObjects[kGeometryVao][kHeightBuffer]));
-		CHECK_GL_ERROR(glBufferData(GL_ARRAY_BUFFER,
-			sizeof(float) * tHeights.size(),
-			&tHeights[0], GL_STATIC_DRAW));
+		stageStart = std::chrono::steady_clock::now();
+		gpuTimer->begin(kGpuUpload);
+		{
+			TRACE_ZONE("upload normals");
+			CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER,
+				gBufferObjects[kGeometryVao][kNormalBuffer]));
+			CHECK_GL_ERROR(glBufferData(GL_ARRAY_BUFFER,
+				sizeof(float) * tNormals.size() * 4,
+				&tNormals[0], GL_STATIC_DRAW));
+		}
+		{
+			TRACE_ZONE("upload temps");
+			CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER,
+				gBufferObjects[kGeometryVao][kTempBuffer]));
+			CHECK_GL_ERROR(glBufferData(GL_ARRAY_BUFFER,
+				sizeof(float) * tTemps.size(),
+				&tTemps[0], GL_STATIC_DRAW));
+		}
+		{
+			TRACE_ZONE("upload heights");
+			CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER,
+				gBufferObjects[kGeometryVao][kHeightBuffer]));
+			CHECK_GL_ERROR(glBufferData(GL_ARRAY_BUFFER,
+				sizeof(float) * tHeights.size(),
+				&tHeights[0], GL_STATIC_DRAW));
+		}
+		gpuTimer->end();
+		stageEnd = std::chrono::steady_clock::now();
+		times.upload = std::chrono::duration<double, std::milli>(stageEnd - stageStart).count();
+		if (gpuFresh) { // each result counted once, on the frame it came back
+			times.gpuUpload = gpuTimes[kGpuUpload];
+			times.gpuTerrain = gpuTimes[kGpuTerrain];
+			times.gpuWater = gpuTimes[kGpuWater];
+		}
+		if (replaying) {
+			frameReport.add(times);
+		}
+
+		// Fill the per-frame block shared by the terrain and water programs.
+		FrameUniforms frameBlock;
+		frameBlock.projection = projection_matrix;
+		frameBlock.view = view_matrix;
+		frameBlock.lPos = lightPos;
+		frameBlock.cPos = vec4(camera.getEye(), 1.0f);
+		frameBlock.sceneCol = tSceneCol;
+		frameBlock.fogDist = tFogDist;
+		frameBlock.ambConst = ambConstant;
+		frameBlock.seaLev = seaLevel;
+		frameBlock.time = wTime;
+		CHECK_GL_ERROR(glBindBuffer(GL_UNIFORM_BUFFER, frameUbo));
+		CHECK_GL_ERROR(glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frameBlock));
 
 		// Use our program.
 		CHECK_GL_ERROR(glUseProgram(tProgram));
 
-		// Pass uniforms for terrain shaders in.
-		CHECK_GL_ERROR(glUniformMatrix4fv(projMatLoc, 1, GL_FALSE,
-			&projection_matrix[0][0]));
-		CHECK_GL_ERROR(glUniformMatrix4fv(viewMatLoc, 1, GL_FALSE,
-			&view_matrix[0][0]));
-		CHECK_GL_ERROR(glUniform4fv(lPosLoc, 1, &lightPos[0]));
-		CHECK_GL_ERROR(glUniform4fv(cPosLoc, 1, &camera.getEye()[0]));
-		CHECK_GL_ERROR(glUniform4fv(ambLoc, 1, &tAmbient[0]));
-		CHECK_GL_ERROR(glUniform4fv(sceneColLoc, 1, &tSceneCol[0]));
-		CHECK_GL_ERROR(glUniform1f(fogDistLoc, tFogDist));
-		CHECK_GL_ERROR(glUniform1f(ambCLoc, ambConstant));
-		CHECK_GL_ERROR(glUniform4fv(specLoc, 1, &tSpecular[0]));
-		CHECK_GL_ERROR(glUniform1f(shinyLoc, tShininess));
-		CHECK_GL_ERROR(glUniform1i(dirtTexLoc, 0));
-		CHECK_GL_ERROR(glUniform1i(snowTexLoc, 1));
-		CHECK_GL_ERROR(glUniform1i(gravelTexLoc, 2));
-		CHECK_GL_ERROR(glUniform1i(grassTexLoc, 4));
-		CHECK_GL_ERROR(glUniform1i(iceTexLoc, 5));
-		CHECK_GL_ERROR(glUniform1i(rockTexLoc, 6));
-		CHECK_GL_ERROR(glUniform1i(sandTexLoc, 7));
-		CHECK_GL_ERROR(glUniform1f(seaLevLoc, seaLevel));
-
-
 		// Draw our triangles.
-		CHECK_GL_ERROR(glDrawElements(GL_TRIANGLES, tFaces.size() * 3, GL_UNSIGNED_INT, 0));
+		{
+			TRACE_ZONE("draw terrain");
+			gpuTimer->begin(kGpuTerrain);
+			CHECK_GL_ERROR(glMultiDrawElementsBaseVertex(GL_TRIANGLES, &tCounts[0], GL_UNSIGNED_SHORT,
+				&tOffsets[0], tChunks, &tBaseVertices[0]));
+			gpuTimer->end();
+		}
 
 		// Switch to water vao and then send everything to the GPU
 		// Switch to the Water VAO.
@@ -939,55 +882,62 @@ void run_opengl() {
 		// Use our program.
 		CHECK_GL_ERROR(glUseProgram(wProgram));
 
-		// Pass uniforms for water shaders in.
-		CHECK_GL_ERROR(glUniformMatrix4fv(projMatLocW, 1, GL_FALSE,
-			&projection_matrix[0][0]));
-		CHECK_GL_ERROR(glUniformMatrix4fv(viewMatLocW, 1, GL_FALSE,
-			&view_matrix[0][0]));
-		CHECK_GL_ERROR(glUniform4fv(lPosLocW, 1, &lightPos[0]));
-		CHECK_GL_ERROR(glUniform4fv(cPosLocW, 1, &camera.getEye()[0]));
-		CHECK_GL_ERROR(glUniform4fv(ambLocW, 1, &wAmbient[0]));
-		CHECK_GL_ERROR(glUniform1f(ambCLocW, ambConstant));
-		CHECK_GL_ERROR(glUniform4fv(sceneColLocW, 1, &tSceneCol[0]));
-		CHECK_GL_ERROR(glUniform1f(fogDistLocW, tFogDist));
-		CHECK_GL_ERROR(glUniform4fv(specLocW, 1, &wSpecular[0]));
-		CHECK_GL_ERROR(glUniform1f(shinyLocW, wShininess));
-		CHECK_GL_ERROR(glUniform1i(timeLocW, wTime));
-		CHECK_GL_ERROR(glUniform1i(texLocW, 3));
-		CHECK_GL_ERROR(glUniform1f(seaLevelW, seaLevel));
-
-		CHECK_GL_ERROR(glDrawElements(GL_TRIANGLES, wFaces.size() * 3, GL_UNSIGNED_INT, 0));
+		// Only chunks with terrain below the surface get water.
+		single->waterChunks(seaLevel, wChunks);
+		wCounts.assign(wChunks.size(), wFaces.size() * 3);
+		wOffsets.assign(wChunks.size(), wIndexOffset);
+		wBaseVertices.resize(wChunks.size());
+		for (size_t c = 0; c < wChunks.size(); c++) {
+			wBaseVertices[c] = wChunks[c] * single->waterChunkSize();
+		}
+		{
+			TRACE_ZONE("draw water");
+			gpuTimer->begin(kGpuWater);
+			if (!wChunks.empty()) {
+				CHECK_GL_ERROR(glMultiDrawElementsBaseVertex(GL_TRIANGLES, &wCounts[0], GL_UNSIGNED_SHORT,
+					&wOffsets[0], wChunks.size(), &wBaseVertices[0]));
+			}
+			gpuTimer->end();
+		}
 		// END OF WATER SHADER STUFF
 
 		// Poll and swap.
 		glfwPollEvents();
+		TRACE_ZONE("swap buffers");
 		glfwSwapBuffers(gl_window);
 	}
-	running = false;
+	// write out the trace, the replay report or the recorded path
+	if (Trace::enabled()) {
+		toggleTrace();
+	}
+	if (replaying) {
+		FILE *f = reportFile.empty() ? stdout : fopen(reportFile.c_str(), "w");
+		if (f) {
+			frameReport.write(f, replayName, single->dim);
+			fprintf(f, "\n");
+			if (f != stdout) {
+				fclose(f);
+			}
+		}
+	}
+	else if (!recordFile.empty() && !cameraPath.save(recordFile)) {
+		std::cerr << "Could not save camera path to " << recordFile << "\n";
+	}
+	gpuTimer.reset(); // queries go before the context does
 	glfwDestroyWindow(gl_window);
 	glfwTerminate();
 	exit(EXIT_SUCCESS);
 }
 
-void fps_calc() {
-	int t = time(0);
-	cout << "Before Loop" << endl;
-	while (running) {
-		if (time(0) > t) {
-			t = time(0);
-			std::string ff = std::to_string(fps);
-
-			box->label(ff.c_str());
-			Fl::flush();
-			fps = 0;
-		}
-	}
-}
-
 int main(int argc, char* argv[])
 {
+	// parse our own options (e.g. -view 480) before anything reads viewDim
+	int argi = 1;
+	Fl::args(argc, argv, argi, argHandler);
+
+	// enable FLTK's thread support so the render thread can use Fl::awake
+	Fl::lock();
 	std::thread gl_thread(run_opengl);
-	std::thread fps_thread(fps_calc);
 	//gl_thread.join();
 
 	/**********************************************************************
@@ -1003,6 +953,11 @@ int main(int argc, char* argv[])
 	box->box(FL_UP_BOX);
 	box->labelsize(20);
 	box->labelfont(FL_HELVETICA);
+
+	// Box which contains the frame time percentiles
+	frameTimesBox->box(FL_NO_BOX);
+	frameTimesBox->labelsize(11);
+	frameTimesBox->align(FL_ALIGN_INSIDE | FL_ALIGN_LEFT);
 	
 	// Button which brings up sea level settings panel
 	btnSeaLvl->image(imgSeaLvl);
@@ -1018,6 +973,7 @@ int main(int argc, char* argv[])
 	mainWindow->set_modal();
 	mainWindow->add(lbl_fps);
 	mainWindow->add(box);
+	mainWindow->add(frameTimesBox);
 	mainWindow->add(btnSeaLvl);
 	mainWindow->add(btnNoiseP);
 	mainWindow->remove(seaLevelPanel);
@@ -0,0 +1,30 @@
+#include "settings.h"
+
+// Init settings
+double seaLevel = 1.0;
+
+// Elevation settings
+double height1a = 1.0;
+double height1b = 10.0;
+double height1c = 10.0;
+double height2a = 0.5;
+double height2b = 20.0;
+double height2c = 20.0;
+double height3a = 0.25;
+double height3b = 50.0;
+double height3c = 30.0;
+
+// Raise elevation by power
+double heightPow = 2.33334;
+
+// sea level settings
+double slHeighta = 0.25;
+double slHeightb = 5.0;
+double slHeightc = 5.0;
+
+// multiplier
+double maxH = 20.001;
+
+// octave level of detail
+double lodPixels = 1.0;
+double lodPixelsPerRadian = 800.0 / 0.785398; // window height over a 45 degree field of view